@@ -304,6 +304,18 @@ inline void db_tables_create( __attribute__ ((unused)) const std::vector<std::st
   }
 }
 
+inline void db_tables_migrate_blob( const std::vector<std::string>& args ) {
+	Service db;
+	db.init("db");
+  std::shared_ptr<PayloadAdapterDb> adapter = std::dynamic_pointer_cast<PayloadAdapterDb>( db.getPayloadAdapterDb() );
+	Result<size_t> rc = adapter->migrateDataToBlob( args.size() >= 2 ? args[1] : "" );
+  if ( rc.valid() ) {
+    std::cout << rc.get() << " payload data rows were moved to binary storage" << std::endl;
+  } else {
+    std::cerr << "failed to migrate payload data, " << rc.msg() << std::endl;
+  }
+}
+
 inline void db_tables_list( __attribute__ ((unused)) const std::vector<std::string>& args ) {
 	Service db;
 	db.init("db");
@@ -1,6 +1,8 @@
 
 #include <npp/cdb/cdb.h>
+#include <npp/util/compression.h>
 
+#include <ctime>
 #include <iostream>
 
 namespace NPP {
@@ -342,5 +344,89 @@ inline void http_tags_import( const std::vector<std::string>& args ) {
   }
 }
 
+inline void http_test_compressed( const std::vector<std::string>& args ) {
+  if ( args.size() < 2 ) {
+    std::cerr << "ERROR: please provide argument: <path>/<struct> [codec]" << "\n";
+    return;
+  }
+  std::vector<std::string> codecs = codecs_available();
+  std::string codec = args.size() >= 3 ? args[2] : ( codecs.size() ? codecs[0] : "" );
+  if ( !codec_available( codec ) ) {
+    std::cerr << "ERROR: no compression codec available in this build: " << codec << "\n";
+    return;
+  }
+
+  int failures = 0;
+  auto check = [&failures]( bool ok, const std::string& what ) {
+    if ( ok ) {
+      std::cout << "SUCCESS: " << what << std::endl;
+    } else {
+      std::cerr << "ERROR: " << what << std::endl;
+      failures++;
+    }
+  };
+
+  // compress, upload, download and decode: binary frames must survive the trip in full
+  Service db;
+  db.init("http");
+  std::string path = args[1];
+  Result<SPayloadPtr_t> res = db.prepareUpload( path );
+  if ( res.invalid() ) {
+    std::cerr << "ERROR: payload cannot be prepared, because: " << res.msg() << "\n";
+    return;
+  }
+  SPayloadPtr_t p{res.get()};
+
+  int64_t now = std::time(nullptr);
+  if ( p->mode() == 1 ) {
+    p->setBeginTime( now - 10 );
+    p->setEndTime( now - 9 );
+  } else if ( p->mode() == 2 ) {
+    p->setRun( now );
+    p->setSeq( 1 );
+  } else {
+    std::cerr << "unknown payload mode: " << p->mode() << "\n";
+    return;
+  }
+
+  std::string data;
+  for ( int i = 0; data.size() < 64 * 1024; ++i ) {
+    data += "row " + std::to_string(i) + ": " + std::to_string( i % 97 ) + "\n";
+  }
+  p->setData( data, "dat" );
+  Result<bool> packed = p->compress( codec );
+  check( packed.valid() && packed.get(), "payload data compressed with " + codec );
+  check( p->storedData().find( '\0' ) != std::string_view::npos, "compressed bytes contain NUL bytes" );
+
+  Result<std::string> rc = db.setPayload( p );
+  check( rc.valid(), "compressed payload uploaded" + ( rc.valid() ? "" : ": " + rc.msg() ) );
+  if ( rc.valid() ) {
+    Service reader;
+    reader.init("http");
+    reader.setFlavors({ p->flavor() });
+    reader.setEventTime( now - 10 );
+    reader.setRun( now );
+    reader.setSeq( 1 );
+
+    PayloadResults_t found = reader.getPayloads({ path });
+    auto it = found.find( p->directory() + "/" + p->structName() );
+    check( it != found.end() && it->second->id() == p->id(), "uploaded payload found" );
+    if ( it != found.end() && it->second->id() == p->id() ) {
+      check( it->second->data() == data, "payload decoded to the uploaded data, stored as " + it->second->storedFormat() );
+    }
+
+    Result<std::string> deactivated = db.deactivatePayload( p, std::time(nullptr) );
+    if ( deactivated.invalid() ) {
+      std::cerr << "WARNING: test payload " << p->id() << " is left active: " << deactivated.msg() << std::endl;
+    }
+  }
+
+  if ( failures ) {
+    std::cerr << "FAILED: " << failures << " checks" << std::endl;
+  } else {
+    std::cout << "compressed http round trip passed" << std::endl;
+  }
+}
+
 } // namespace CLI
 } // namespace NPP
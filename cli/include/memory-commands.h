@@ -1,6 +1,8 @@
 
 #include <npp/cdb/cdb.h>
 
+#include <limits>
+
 namespace NPP {
 namespace CLI {
 
@@ -80,6 +82,89 @@ inline void memory_test_setget( __attribute__ ((unused)) const std::vector<std::
   } else {
 		std::cerr << "ERROR: search for payload 2 by run/seq yielded " << res.size() << " results" << std::endl;
 	}
+
+	// lookups on adapters of their own: interval edges, run/seq, maxEntryTime visibility and eviction
+	int failures = 0;
+	auto check = [&failures]( bool ok, const std::string& what ) {
+		if ( ok ) {
+			std::cout << "SUCCESS: " << what << std::endl;
+		} else {
+			std::cerr << "ERROR: " << what << std::endl;
+			failures++;
+		}
+	};
+	auto make = []( const std::string& id, int64_t ct, int64_t bt, int64_t et, int64_t dt, int64_t run, int64_t seq ) {
+		SPayloadPtr_t p = std::make_shared<Payload>( id, "pid345", "ofl", "struct2", "Calibrations/tpc", ct, bt, et, dt, run, seq );
+		p->setMode( run ? 2 : 1 );
+		p->setURI( "db://test/" + id );
+		return p;
+	};
+	auto lookup = []( PayloadAdapterMemory& memory, int64_t maxEntryTime, int64_t eventTime, int64_t run = 0, int64_t seq = 0 ) {
+		Result<SPayloadPtr_t> rc = memory.getPayload( "ofl:Calibrations/tpc/struct2", {}, {}, maxEntryTime, eventTime, run, seq );
+		return rc.valid() ? rc.get()->id() : std::string("miss");
+	};
+
+	PayloadAdapterMemory edges;
+	for ( const auto& p : { make( "a", 10, 100, 200, 0, 0, 0 ), make( "b", 10, 200, 300, 0, 0, 0 ), make( "c", 10, 400, 500, 0, 0, 0 ),
+			make( "a2", 50, 100, 150, 0, 0, 0 ), make( "a3", 60, 100, 150, 70, 0, 0 ), make( "r", 10, 0, 0, 0, 7, 1 ) } ) {
+		if ( edges.setPayload( p ).invalid() ) { check( false, "cannot set payload " + p->id() ); }
+	}
+	check( lookup( edges, 0, 50 ) == "miss", "miss before the first interval" );
+	check( lookup( edges, 0, 100 ) == "a3", "beginTime is inclusive, newest insertion wins" );
+	check( lookup( edges, 0, 199 ) == "a", "hit just before endTime" );
+	check( lookup( edges, 0, 200 ) == "b", "endTime is exclusive" );
+	check( lookup( edges, 0, 300 ) == "miss", "miss in a gap between intervals" );
+	check( lookup( edges, 0, 450 ) == "c", "hit in the last interval" );
+	check( lookup( edges, 0, 500 ) == "miss", "miss past the last interval" );
+	check( lookup( edges, 55, 120 ) == "a2", "entry created after maxEntryTime is hidden" );
+	check( lookup( edges, 75, 120 ) == "a2", "entry deactivated before maxEntryTime is hidden" );
+	check( lookup( edges, 40, 120 ) == "a", "older version is visible before newer ones were created" );
+	check( lookup( edges, 5, 120 ) == "miss", "nothing is visible before it was created" );
+	check( lookup( edges, 0, 0, 7, 1 ) == "r", "exact run/seq match" );
+	check( lookup( edges, 0, 0, 7, 2 ) == "miss", "run/seq mismatch" );
+
+	PayloadAdapterMemory small;
+	small.setCacheItemLimit( 2, 4 );
+	for ( int64_t i = 0; i < 5; ++i ) {
+		small.setPayload( make( "e" + std::to_string(i), 10, 100 + i * 100, 200 + i * 100, 0, 0, 0 ) );
+	}
+	CacheStats small_stats = small.cacheStats();
+	check( small_stats.items == 3 && small_stats.evictions == 2, "eviction brings the item count down to the lo limit" );
+	check( lookup( small, 0, 150 ) == "miss" && lookup( small, 0, 250 ) == "miss", "least recently used entries are evicted first" );
+	check( lookup( small, 0, 350 ) == "e2" && lookup( small, 0, 550 ) == "e4", "remaining entries are still found" );
+	// hits between two insertions must still be ordered, the entry touched longest ago goes first
+	PayloadAdapterMemory recent;
+	recent.setCacheItemLimit( 3, 4 );
+	for ( int64_t i = 0; i < 3; ++i ) {
+		recent.setPayload( make( "h" + std::to_string(i), 10, 100 + i * 100, 200 + i * 100, 0, 0, 0 ) );
+	}
+	lookup( recent, 0, 350 );
+	lookup( recent, 0, 150 );
+	lookup( recent, 0, 250 );
+	recent.setPayload( make( "h3", 10, 400, 500, 0, 0, 0 ) );
+	check( lookup( recent, 0, 350 ) == "miss", "lru evicts the entry hit longest ago" );
+	check( lookup( recent, 0, 150 ) == "h0" && lookup( recent, 0, 250 ) == "h1", "recently hit entries are kept" );
+	// a prefetched timeline as the db adapter hands it over: the newest IOV is open-ended, valid until int64 max
+	PayloadAdapterMemory prefetched;
+	PayloadList_t timeline{ make( "t1", 10, 1000, 2000, 0, 0, 0 ), make( "t2", 10, 2000, 3000, 0, 0, 0 ),
+		make( "t3", 10, 3000, std::numeric_limits<int64_t>::max(), 0, 0, 0 ) };
+	CacheInsertion inserted = prefetched.setPayloads( timeline );
+	check( inserted.inserted == 3 && inserted.evicted == 0, "prefetched timeline is cached in one insert" );
+	check( lookup( prefetched, 0, 2500 ) == "t2", "prefetched closed IOV is served from memory" );
+	check( lookup( prefetched, 0, 3000 ) == "t3" && lookup( prefetched, 0, 4102444800 ) == "t3", "prefetched open-ended IOV is served from memory" );
+	check( prefetched.setPayloads( timeline ).inserted == 0, "prefetched payloads are cached only once" );
+
+	PayloadAdapterMemory tight;
+	tight.setCacheItemLimit( 1, 2 );
+	CacheInsertion overflow = tight.setPayloads( timeline );
+	check( overflow.inserted == 3 && overflow.evicted == 2, "bulk insert reports entries evicted by the cache limits" );
+
+	std::cout << ( failures ? "FAILED: " + std::to_string( failures ) + " checks" : std::string("all memory adapter checks passed") ) << std::endl;
+
+	CacheStats stats = adapter->cacheStats();
+	std::cout << "cache [" << adapter->evictionPolicy() << "]: items: " << stats.items << ", bytes: " << stats.bytes << ", mapped bytes: " << stats.mapped_bytes
+		<< ", hits: " << stats.hits << ", misses: " << stats.misses
+		<< ", insertions: " << stats.insertions << ", evictions: " << stats.evictions << std::endl;
 }
 
 } // namespace CLI
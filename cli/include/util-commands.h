@@ -0,0 +1,59 @@
+
+#include <npp/util/base64.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+namespace NPP {
+namespace CLI {
+
+using namespace NPP::Util;
+
+// throughput of every base64 implementation the cpu supports, GB/s of raw (unencoded) data
+inline void util_bench_base64( const std::vector<std::string>& args ) {
+	size_t rounds = args.size() >= 2 ? std::stoul( args[1] ) : 3;
+	if ( !rounds ) { rounds = 1; }
+
+	std::mt19937_64 rng( 12345 );
+	std::cout << "best implementation: " << base64::name( base64::best() ) << "\n";
+
+	for ( size_t mb : { 1, 10, 100 } ) {
+		std::string data( mb * 1024 * 1024, '\0' );
+		for ( size_t i = 0; i + 8 <= data.size(); i += 8 ) {
+			uint64_t v = rng();
+			std::memcpy( &data[i], &v, sizeof(v) );
+		}
+
+		for ( auto impl : { base64::Impl::Scalar, base64::Impl::Sse41, base64::Impl::Avx2 } ) {
+			if ( !base64::supported( impl ) ) { continue; }
+			std::string encoded, decoded;
+			double enc_best = 0, dec_best = 0;
+			// small payloads are repeated up to ~100 MB per measurement, the best of all rounds is reported
+			size_t reps = std::max( size_t(1), size_t(100) / mb );
+			for ( size_t r = 0; r < rounds; ++r ) {
+				double enc_sec = 0, dec_sec = 0;
+				for ( size_t k = 0; k < reps; ++k ) {
+					auto t0 = std::chrono::steady_clock::now();
+					encoded = base64::encode( data, impl );
+					auto t1 = std::chrono::steady_clock::now();
+					decoded = base64::decode( encoded, impl );
+					auto t2 = std::chrono::steady_clock::now();
+					enc_sec += std::chrono::duration<double>( t1 - t0 ).count();
+					dec_sec += std::chrono::duration<double>( t2 - t1 ).count();
+				}
+				enc_best = std::max( enc_best, reps * data.size() / enc_sec / 1e9 );
+				dec_best = std::max( dec_best, reps * data.size() / dec_sec / 1e9 );
+			}
+			std::cout << std::setw(4) << mb << " MB " << std::setw(7) << base64::name( impl )
+				<< std::fixed << std::setprecision(2) << "  encode: " << enc_best << " GB/s  decode: " << dec_best << " GB/s"
+				<< ( decoded == data ? "" : "  ROUND TRIP FAILED" ) << "\n";
+		}
+	}
+}
+
+} // namespace CLI
+} // namespace NPP
@@ -8,6 +8,7 @@
 #include "file-commands.h"
 #include "http-commands.h"
 #include "memory-commands.h"
+#include "util-commands.h"
 
 #include <iostream>
 
@@ -31,6 +32,7 @@ int main(int argc, const char *argv[]) {
 	cmds.registerCommand("db:tables:create", "", "Initializes database tables", db_tables_create );
 	cmds.registerCommand("db:tables:list", "", "Lists all database tables", db_tables_list );
 	cmds.registerCommand("db:tables:drop", "", "Deletes all existing db tables", db_tables_drop );
+	cmds.registerCommand("db:tables:migrate-blob", "[tbname]", "Moves base64 payload data into binary columns", db_tables_migrate_blob );
 
 	cmds.registerCommand("db:schema:set", "<path>/<struct> <file>", "Sets schema for <struct> from <file>", db_schema_set );
 	cmds.registerCommand("db:schema:get", "<path>/<struct>", "Gets schema for <struct>", db_schema_get );
@@ -74,9 +76,12 @@ int main(int argc, const char *argv[]) {
 
 	cmds.registerCommand("http:tags:export", "<file>", "Exports all tags and schemas into the file (json)", http_tags_export );
 	cmds.registerCommand("http:tags:import", "<file>", "Imports tags and schemas from file (json)", http_tags_import );
+	cmds.registerCommand("http:test:compressed", "<path>/<struct> [codec]", "Round-trips a compressed payload through the http server", http_test_compressed );
 
 	cmds.registerCommand("memory:test:setget", "", "Self-tests memory adapter", memory_test_setget );
 
+	cmds.registerCommand("util:bench:base64", "[rounds]", "Measures base64 encode/decode throughput on 1, 10 and 100 MB", util_bench_base64 );
+
 	cmds.process( argc, argv );
 
 	return EXIT_SUCCESS;
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace NPP {
+namespace CDB {
+
+	// snapshot of per-entry usage counters, taken at eviction time
+	struct CacheEntryStats {
+		uint64_t inserted{0}; // cache tick at insertion
+		uint64_t accessed{0}; // cache tick of the last hit (or insertion), hits advance the tick as well
+		uint64_t hits{0};
+		size_t size{0};
+	};
+
+	class ICacheEvictionPolicy;
+	using ICacheEvictionPolicyPtr_t = std::shared_ptr<ICacheEvictionPolicy>;
+
+	class ICacheEvictionPolicy {
+		public:
+			ICacheEvictionPolicy( const std::string& id ) : mId(id) {}
+			virtual ~ICacheEvictionPolicy() = default;
+
+			const std::string& id() const { return mId; }
+
+			// true if entry a should be evicted before entry b
+			virtual bool evictBefore( const CacheEntryStats& a, const CacheEntryStats& b ) const = 0;
+
+		private:
+			std::string mId;
+	};
+
+	// first in, first out: hits are ignored
+	class CacheEvictionPolicyFifo : public ICacheEvictionPolicy {
+		public:
+			CacheEvictionPolicyFifo() : ICacheEvictionPolicy("fifo") {}
+			bool evictBefore( const CacheEntryStats& a, const CacheEntryStats& b ) const override {
+				return a.inserted < b.inserted;
+			}
+	};
+
+	// least recently used first
+	class CacheEvictionPolicyLru : public ICacheEvictionPolicy {
+		public:
+			CacheEvictionPolicyLru() : ICacheEvictionPolicy("lru") {}
+			bool evictBefore( const CacheEntryStats& a, const CacheEntryStats& b ) const override {
+				return a.accessed < b.accessed;
+			}
+	};
+
+	// least frequently used first, least recently used among equals
+	class CacheEvictionPolicyLfu : public ICacheEvictionPolicy {
+		public:
+			CacheEvictionPolicyLfu() : ICacheEvictionPolicy("lfu") {}
+			bool evictBefore( const CacheEntryStats& a, const CacheEntryStats& b ) const override {
+				return a.hits != b.hits ? a.hits < b.hits : a.accessed < b.accessed;
+			}
+	};
+
+	// lowest hits-per-byte first: large rarely used payloads go before small hot ones
+	class CacheEvictionPolicySize : public ICacheEvictionPolicy {
+		public:
+			CacheEvictionPolicySize() : ICacheEvictionPolicy("size") {}
+			bool evictBefore( const CacheEntryStats& a, const CacheEntryStats& b ) const override {
+				long double wa = static_cast<long double>( a.hits + 1 ) * ( b.size ? b.size : 1 );
+				long double wb = static_cast<long double>( b.hits + 1 ) * ( a.size ? a.size : 1 );
+				return wa != wb ? wa < wb : a.accessed < b.accessed;
+			}
+	};
+
+	inline ICacheEvictionPolicyPtr_t makeCacheEvictionPolicy( const std::string& id ) {
+		if ( id == "fifo" ) { return std::make_shared<CacheEvictionPolicyFifo>(); }
+		if ( id == "lru" ) { return std::make_shared<CacheEvictionPolicyLru>(); }
+		if ( id == "lfu" ) { return std::make_shared<CacheEvictionPolicyLfu>(); }
+		if ( id == "size" ) { return std::make_shared<CacheEvictionPolicySize>(); }
+		return nullptr;
+	}
+
+} // namespace CDB
+} // namespace NPP
@@ -3,6 +3,7 @@
 #include <npp/cdb/service.h>
 #include <npp/cdb/payload.h>
 #include <npp/cdb/i_payload_adapter.h>
+#include <npp/cdb/cache_eviction_policy.h>
 #include <npp/cdb/payload_adapter_memory.h>
 #include <npp/cdb/payload_adapter_file.h>
 #include <npp/cdb/payload_adapter_db.h>
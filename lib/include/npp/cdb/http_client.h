@@ -1,9 +1,13 @@
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <string>
+#include <vector>
 
 #include "npp/cdb/http_curl_holder.h"
 #include "npp/cdb/http_response.h"
+#include "npp/cdb/http_response_cache.h"
 
 namespace NPP {
 namespace CDB {
@@ -11,6 +15,7 @@ namespace CDB {
 	class HttpClient;
 
 	using HttpClientPtr_t = std::shared_ptr<HttpClient>;
+	using HttpTokenSource_t = std::function<std::string( const std::string& url )>; // token for a request to url
 
 	class HttpClient {
 		public:
@@ -21,16 +26,33 @@ namespace CDB {
 			void setUserAgent( const std::string& userAgent ) { mUserAgent = userAgent; }
 			void setVerbose( bool verbose ) { mVerbose = verbose; }
 			void setTimeout( long timeout_ms ) { mTimeoutMs = timeout_ms; }
+			long timeout() const { return mTimeoutMs; }
 			void setConnectTimeout( long timeout_ms ) { mConnectTimeoutMs = timeout_ms; }
 			void setVerifySsl( bool verifySsl ) { mVerifySsl = verifySsl; }
-			void setMaxRetries( unsigned int r ) { mMaxRetries = r; }
-			void setSleepSeconds( unsigned int s ) { mSleepSeconds = s; }
+			void setMaxRetries( unsigned int r ) { mRetryPolicy.maxRetries = r; }
+			void setSleepSeconds( unsigned int s ) { mRetryPolicy.maxBackoffMs = s * 1000L; } // legacy, caps the backoff now
+			void setRetryPolicy( const HttpRetryPolicy& policy ) { mRetryPolicy = policy; }
+			const HttpRetryPolicy& retryPolicy() const { return mRetryPolicy; }
+			void setMaxIdleHandles( size_t n ) { mHandlePool->setMaxIdle( n ); }
+			void setHttp2( bool http2 ) { mHttp2 = http2; }
+			void setMaxConcurrentRequests( size_t n ) { mMaxConcurrentRequests = n ? n : 1; }
+			void setResponseCacheBytes( size_t n ) { mResponseCache.setMaxBytes( n ); }
+			HttpResponseCache& responseCache() { return mResponseCache; }
 
-			HttpResponse Get( const std::string& url );
-			HttpCurlHolderPtr_t PrepareGet( const std::string& url );
+			// token given per request takes precedence over setToken, so concurrent requests do not share it;
+			// GET replies go through the response cache, conditional requests revalidate stale copies by ETag
+			HttpResponse Get( const std::string& url, const std::string& token = "" );
+			HttpCurlHolderPtr_t PrepareGet( const std::string& url, const std::string& token = "", bool conditional = true );
 
-			HttpResponse Post( const std::string& url, const HttpPostParams_t& params, const std::string& filename = "", const std::string& filedata = "" );
-			HttpCurlHolderPtr_t PreparePost( const std::string& url, const HttpPostParams_t& params, const std::string& filename = "", const std::string& filedata = "");
+			// up to max concurrent requests in flight at once on a curl multi handle, responses in the order of urls
+			std::vector<HttpResponse> GetMany( const std::vector<std::string>& urls, const std::string& token = "" );
+			// tokens are asked for right before each transfer and retry, so late ones in a long batch do not go out expired
+			std::vector<HttpResponse> GetMany( const std::vector<std::string>& urls, const HttpTokenSource_t& token );
+
+			HttpResponse Post( const std::string& url, const HttpPostParams_t& params, const std::string& filename = "", const std::string& filedata = "",
+				const std::string& token = "" );
+			HttpCurlHolderPtr_t PreparePost( const std::string& url, const HttpPostParams_t& params, const std::string& filename = "", const std::string& filedata = "",
+				const std::string& token = "" );
 
 			HttpResponse Post( const std::string& url, const std::string& body, const std::string& header );
 			HttpCurlHolderPtr_t PreparePost( const std::string& url, const std::string& body, const std::string& header );
@@ -42,17 +64,20 @@ namespace CDB {
 			std::string urlDecode(const std::string& s) const { return mEncoder.urlDecode(s); }
 
 		private:
-			void SetCommon( HttpCurlHolderPtr_t& curl_ );
+			void SetCommon( HttpCurlHolderPtr_t& curl_, const std::string& token = "" );
 
 			HttpCurlHolder mEncoder;
+			HttpCurlHandlePoolPtr_t mHandlePool{ std::make_shared<HttpCurlHandlePool>() }; // shared with in-flight requests
+			HttpResponseCache mResponseCache{ 32 * 1024 * 1024 };
 			bool mVerbose{false};
 			long mTimeoutMs{1000};
 			long mConnectTimeoutMs{1000};
 			std::string mUserAgent{"CDBNPP-Http-Client"};
 			bool mVerifySsl{false};
 			std::string mToken{};
-			unsigned int mMaxRetries{30};
-			unsigned int mSleepSeconds{30};
+			HttpRetryPolicy mRetryPolicy{};
+			bool mHttp2{false};
+			size_t mMaxConcurrentRequests{8};
 	};
 
 } // namespace CDB
@@ -12,13 +12,57 @@ namespace NPP {
 namespace CDB {
 
 	class HttpCurlHolder;
+	class HttpCurlHandlePool;
 
 	using HttpCurlHolderPtr_t = std::shared_ptr<HttpCurlHolder>;
+	using HttpCurlHandlePoolPtr_t = std::shared_ptr<HttpCurlHandlePool>;
 	using HttpPostParams_t = std::vector<std::pair<std::string,std::string>>;
 
+	// retries with exponential backoff and full jitter, bounded by a total deadline across all attempts of a request;
+	// only transient failures are retried: connection problems, timeouts, 429 and 5xx replies
+	struct HttpRetryPolicy {
+		unsigned int maxRetries{3};
+		long initialBackoffMs{200};
+		long maxBackoffMs{5000};
+		long deadlineMs{30000}; // 0 = no deadline
+
+		long backoffMs( unsigned int attempt ) const; // random delay before retry number attempt + 1
+		long windowMs( long timeoutMs ) const; // longest a request with attempts of timeoutMs each may take
+		static bool isRetryable( CURLcode rc, long http_code );
+	};
+
+	// idle easy handles keep their live connections, so keep-alive connections outlive single requests;
+	// DNS and TLS session caches are shared by all handles of the pool
+	class HttpCurlHandlePool {
+		public:
+			explicit HttpCurlHandlePool( size_t max_idle = 16 );
+			~HttpCurlHandlePool();
+
+			HttpCurlHandlePool( const HttpCurlHandlePool& ) = delete;
+			HttpCurlHandlePool& operator=( const HttpCurlHandlePool& ) = delete;
+
+			CURL* acquire(); // idle handle reset to defaults, nullptr if there is none
+			void release( CURL* handle ); // handles beyond max idle are cleaned up
+			CURLSH* share() { return mShare; }
+
+			void setMaxIdle( size_t max_idle );
+			size_t idle();
+
+		private:
+			static void lockShare( CURL* handle, curl_lock_data data, curl_lock_access access, void* userptr );
+			static void unlockShare( CURL* handle, curl_lock_data data, void* userptr );
+
+			std::mutex mMutex{};
+			std::vector<CURL*> mIdle{};
+			size_t mMaxIdle;
+			CURLSH* mShare{nullptr};
+			std::array<std::mutex, CURL_LOCK_DATA_LAST> mShareMutexes{};
+	}; // class HttpCurlHandlePool
+
 	class HttpCurlHolder {
 		public:
 			HttpCurlHolder();
+			explicit HttpCurlHolder( HttpCurlHandlePoolPtr_t pool ); // handle is taken from and given back to the pool
 			HttpCurlHolder(const HttpCurlHolder& other) = default;
 			HttpCurlHolder(HttpCurlHolder&& old) noexcept = default;
 			~HttpCurlHolder();
@@ -34,11 +78,11 @@ namespace CDB {
 			void SetConnectTimeout( long timeout_ms );
 			void SetUserAgent( const std::string& ua );
 			void SetVerifySsl( bool verify );
+			void SetHttp2( bool http2 ); // HTTP/2 over TLS where the server offers it, lets transfers share a connection
 
 			void SetCommon();
 
-			void SetMaxRetries( unsigned int max_retries ) { mMaxRetries = max_retries; }
-			void SetSleepSeconds( unsigned int sleep_seconds ) { mSleepSeconds = sleep_seconds; }
+			void SetRetryPolicy( const HttpRetryPolicy& policy ) { mRetryPolicy = policy; }
 
 			void SetGET();
 			void SetPOST();
@@ -60,12 +104,12 @@ namespace CDB {
 
 		private:
 			static std::mutex curl_easy_init_mutex_;
+			HttpCurlHandlePoolPtr_t mPool{nullptr};
 			CURL* handle{nullptr};
 			curl_mime* mime{nullptr};
 			struct curl_slist* headers{nullptr};
 			std::string mUserAgent{"Conditions-Database-Client"};
-			unsigned int mMaxRetries{30};
-			unsigned int mSleepSeconds{30};
+			HttpRetryPolicy mRetryPolicy{};
 	}; // class HttpCurlHolder
 
 } // namespace CDB
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace NPP {
+namespace CDB {
+
+	class HttpDiskCache;
+
+	using HttpDiskCachePtr_t = std::shared_ptr<HttpDiskCache>;
+
+	// downloaded payload data kept on local disk, shared by all processes using the same directory:
+	// entries are files named by the sha256 of their key, written to a temporary file and renamed into place,
+	// reads refresh the modification time and the least recently used entries are removed once the size limit is exceeded
+	class HttpDiskCache {
+		public:
+			HttpDiskCache( const std::string& dir, uint64_t max_bytes );
+
+			HttpDiskCache( const HttpDiskCache& ) = delete;
+			HttpDiskCache& operator=( const HttpDiskCache& ) = delete;
+
+			static std::string key( const std::string& id, const std::string& uri );
+
+			bool get( const std::string& key, std::string& data );
+			bool put( const std::string& key, const std::string& data );
+
+			void cleanup(); // drop least recently used entries and abandoned temporary files until under the limit
+
+			const std::string& dir() const { return mDir; }
+			uint64_t maxBytes() const { return mMaxBytes; }
+
+		private:
+			std::string entryPath( const std::string& key ) const;
+
+			std::string mDir;
+			uint64_t mMaxBytes;
+			std::atomic<uint64_t> mWrittenSinceCleanup{0};
+			std::atomic<uint64_t> mTmpCounter{0};
+			std::mutex mCleanupMutex{}; // one cleanup at a time per process, other processes may run theirs concurrently
+	}; // class HttpDiskCache
+
+} // namespace CDB
+} // namespace NPP
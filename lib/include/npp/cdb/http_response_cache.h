@@ -0,0 +1,67 @@
+#pragma once
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "npp/cdb/http_response.h"
+
+namespace NPP {
+namespace CDB {
+
+	// private HTTP cache for GET replies: honors Cache-Control max-age / no-cache / no-store, revalidates stale entries by ETag,
+	// least recently used entries go first once the byte budget is exceeded, zero budget disables caching
+	class HttpResponseCache {
+		public:
+			explicit HttpResponseCache( size_t max_bytes = 0 ) : mMaxBytes(max_bytes) {}
+
+			HttpResponseCache( const HttpResponseCache& ) = delete;
+			HttpResponseCache& operator=( const HttpResponseCache& ) = delete;
+
+			bool lookup( const std::string& url, HttpResponse& response ); // fresh reply, no need to ask the server
+			std::string etag( const std::string& url ); // validator of a stored reply for If-None-Match, empty if there is none
+			HttpResponse update( const std::string& url, HttpResponse&& response ); // stores cacheable replies, 304 becomes the stored reply
+
+			void setMaxBytes( size_t max_bytes );
+			size_t bytes();
+			size_t size();
+			void clear();
+
+		private:
+			using Clock_t = std::chrono::steady_clock;
+
+			// the reply without its curl handle, which goes back to the pool rather than living on in the cache
+			struct Entry {
+				long status{0};
+				std::string text{};
+				std::string header{};
+				std::string url{};
+				std::string etag{};
+				Clock_t::time_point expires{};
+				std::list<std::string>::iterator lru{};
+			};
+
+			// caching directives of the last response in the header block (redirects and 100-continue come first)
+			struct Directives {
+				std::string etag{};
+				long maxAge{0};
+				bool store{false};
+				bool noStore{false};
+			};
+			static Directives parseHeaders( const std::string& header );
+			static HttpResponse toResponse( const Entry& e );
+
+			void erase( std::unordered_map<std::string, Entry>::iterator it );
+			void evict();
+
+			std::mutex mMutex{}; // protects everything below
+			std::unordered_map<std::string, Entry> mEntries{};
+			std::list<std::string> mLru{}; // most recently used first
+			size_t mBytes{0};
+			size_t mMaxBytes;
+	}; // class HttpResponseCache
+
+} // namespace CDB
+} // namespace NPP
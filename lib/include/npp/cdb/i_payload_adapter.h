@@ -3,6 +3,7 @@
 #include <memory>
 #include <string>
 #include <unordered_map>
+#include <vector>
 
 #include <jwt/jwt.hpp>
 
@@ -21,6 +22,7 @@ namespace CDB {
 	class IPayloadAdapter;
 	using IPayloadAdapterPtr_t = std::shared_ptr<IPayloadAdapter>;
 	using PathToTimeMap_t = std::unordered_map<std::string,uint64_t>;
+	using PayloadList_t = std::vector<SPayloadPtr_t>;
 
 	class IPayloadAdapter {
 		public:
@@ -36,6 +38,13 @@ namespace CDB {
 			virtual Result<SPayloadPtr_t> getPayload( const std::string& path, const std::vector<std::string>& flavors,
 				const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime = 0, int64_t eventTime = 0,  int64_t run = 0, int64_t seq = 0 ) = 0;
 
+			// PREFETCH API: all payloads of the paths valid within [rangeBegin, rangeEnd], by event time or by run,
+			// adapters without range lookups return nothing
+			virtual PayloadList_t prefetchPayloads( __attribute__((unused)) const std::set<std::string>& paths,
+				__attribute__((unused)) const std::vector<std::string>& flavors, __attribute__((unused)) const PathToTimeMap_t& maxEntryTimeOverrides,
+				__attribute__((unused)) int64_t maxEntryTime, __attribute__((unused)) int64_t rangeBegin, __attribute__((unused)) int64_t rangeEnd,
+				__attribute__((unused)) bool byRun ) { return {}; }
+
 			// SET API:
 			virtual Result<SPayloadPtr_t> prepareUpload( const std::string& path ) = 0;
 			virtual Result<std::string> setPayload( const SPayloadPtr_t& payload ) = 0;
@@ -2,12 +2,18 @@
 
 #include <nlohmann/json.hpp>
 
+#include <atomic>
 #include <ctime>
 #include <deque>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <string_view>
 #include <tuple>
 #include <vector>
 
+#include "npp/util/result.h"
+#include "npp/util/shared_buffer.h"
 #include "npp/util/util.h"
 
 namespace NPP {
@@ -28,7 +34,7 @@ namespace CDB {
 				int64_t ct, int64_t bt, int64_t et, int64_t dt, int64_t run, int64_t seq ) 
 				: mId(id), mPid(pid), mFlavor(flavor), mStructName(structName), mDirectory(directory),
 					mCreateTime(ct), mBeginTime(bt), mEndTime(et), mDeactiveTime(dt),
-					mRun(run), mSeq(seq) {};
+					mRun(run), mSeq(seq), mMode( ( bt != 0 || et != 0 ) ? 1 : ( ( run != 0 || seq != 0 ) ? 2 : 0 ) ) {};
 			~Payload() = default;
 
 			bool valid() {
@@ -41,6 +47,10 @@ namespace CDB {
 			bool decoded() { return ( valid() && mFlavor.size() && mPid.size() ); }
 			bool ready() { return ( decoded() && ( mURI.size() || mData.size() ) ); }
 
+			// copies would share nothing but the lazily decompressed data, which is not worth it
+			Payload( const Payload& ) = delete;
+			Payload& operator=( const Payload& ) = delete;
+
 			const std::string& id() const { return mId; }
 			const std::string& pid() const { return mPid; }
 			const std::string& flavor() const { return mFlavor; }
@@ -59,13 +69,20 @@ namespace CDB {
 			int64_t run() const { return mRun; }
 			int64_t seq() const { return mSeq; }
 
-			const std::string& format() const { return mFmt; }
+			const std::string& format() const { return mFmt; } // data format, as seen by data()
+			const std::string& codec() const { return mCodec; } // "zstd", "lz4" or empty if stored uncompressed
+			std::string storedFormat() const { return mCodec.size() ? mFmt + "+" + mCodec : mFmt; } // i.e. "json+zstd"
 			int64_t mode() const { return mMode; } // 1 = struct by time, 2 = struct by run,seq
 
-			const std::string& data() const { return mData; }
+			// data is held in shared immutable buffers, views stay valid for as long as the payload lives
+			const std::string& data() const; // decompressed on first access, empty if that fails
+			std::string_view dataView() const; // data() without a copy where the buffer is not a string
+			NPP::Util::SharedBuffer dataBuffer() const; // shares the data, i.e. with another payload
 			nlohmann::json dataAsJson() const;
 
-			size_t dataSize() const { return mData.length(); }
+			std::string_view storedData() const { return mData.view(); } // as stored by adapters, see storedFormat()
+			size_t dataSize() const { return mData.size(); } // stored size
+			bool dataMapped() const { return mData.mapped(); } // stored data is a file mapping, not heap memory
 
 			void setId( const std::string& id ) { mId = id; }
 			void setPid( const std::string& pid ) { mPid = pid; }
@@ -75,11 +92,12 @@ namespace CDB {
 
 			void setURI( const std::string& uri ) {
 				mURI = uri;
-				auto parts = NPP::Util::explode( uri, '.' );
-				std::string fmt = parts.back();
-				NPP::Util::string_to_lower_case(fmt);
-				NPP::Util::sanitize_alnum(fmt);
-				setData( std::string(""), fmt );
+				setData( std::string(""), formatFromURI( uri ) );
+			}
+			// with the format recorded next to the uri by the adapter, the uri extension is used if there is none
+			void setURI( const std::string& uri, const std::string& fmt ) {
+				mURI = uri;
+				setData( std::string(""), fmt.size() ? fmt : formatFromURI( uri ) );
 			}
 
 			void setCreateTime( int64_t createTime ) { mCreateTime = createTime; }
@@ -97,18 +115,32 @@ namespace CDB {
 
 			void setMode( int64_t mode ) { mMode = mode; }
 
+			// fmt may carry a codec, i.e. "cbor+lz4", then data is taken as compressed with it
 			void setData( const std::string& data, const std::string& fmt = "dat" );
+			void setData( std::string&& data, const std::string& fmt = "dat" ); // takes the bytes over, no copy
+			void setData( std::string_view data, const std::string& fmt = "dat" ); // copies, i.e. storedData() of another payload
+			void setData( NPP::Util::SharedBuffer data, const std::string& fmt = "dat" );
 			void setData( const nlohmann::json& data, const std::string& fmt = "json" );
 
-			void clearData() { mData = ""; mFmt = ""; }
+			// attaches the data fetch() returns unless the payload has some already: a payload shared between threads,
+			// i.e. through the memory cache, is filled once, and callers racing the first one wait for it; true if
+			// this call attached the data
+			NPP::Util::Result<bool> fetchDataOnce( const std::function<NPP::Util::Result<NPP::Util::SharedBuffer>()>& fetch );
+			bool hasData() const { return mHasData.load( std::memory_order_acquire ); } // once true, data is safe to read from any thread
+
+			// compresses the data in place, kept uncompressed if the codec does not make it smaller
+			NPP::Util::Result<bool> compress( const std::string& codec, int level = 0 );
+
+			void clearData();
 
 			static DecodedPathTuple decodePath( const std::string& path );
+			static std::string formatFromURI( const std::string& uri ); // file extension, "x.json.zst" => "json+zstd"
 
 			inline friend std::ostream& operator << (std::ostream& os, const Payload* p) {
 		    os << "id: " << p->id() << ", pid: " << p->pid() << ", flavor: " << p->flavor() << ", structName: " << p->structName()
 					<< ", dir: " << p->directory() << ", URI: " << p->URI() << ", ct: " << p->createTime() << ", dt: " << p->deactiveTime()
 					<< ", bt: " << p->beginTime() << ", et: " << p->endTime() << ", run: " << p->run() << ", seq: " << p->seq()
-					<< ", mode: " << p->mode() << ", data_size: " << p->data().size() << ", fmt: " << p->format();
+					<< ", mode: " << p->mode() << ", data_size: " << p->dataSize() << ", fmt: " << p->storedFormat();
     		return os;
 			}
 
@@ -128,8 +160,17 @@ namespace CDB {
 			int64_t mSeq{0};
 
 			int64_t mMode{0}; // 0 = by time, 1 = by run
-			std::string mData{};
+			NPP::Util::SharedBuffer mData{}; // as stored
 			std::string mFmt{}; // dat, json, bson, ubjson, cbor, msgpack
+			std::string mCodec{}; // mData is compressed with it, unless empty
+
+			// decompressed mData, or a string copy of it for data() if it is not held in a string
+			mutable std::mutex mDecodedMutex{};
+			mutable NPP::Util::SharedBuffer mDecoded{};
+			mutable bool mIsDecoded{false};
+
+			std::mutex mFetchMutex{}; // held by fetchDataOnce while fetching
+			std::atomic<bool> mHasData{false}; // published after mData, mFmt and mCodec are set
 	};
 
 } // namespace CDB
@@ -2,16 +2,40 @@
 
 #include <soci/soci.h>
 
+#include <array>
 #include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "npp/cdb/i_payload_adapter.h"
 #include "npp/cdb/tag.h"
+#include "npp/cdb/tag_metadata.h"
+
+#include "npp/util/load_balancer.h"
+#include "npp/util/rng.h"
 
 namespace NPP {
 namespace CDB {
 
 	using namespace NPP::Util;
 
+	struct DbPoolStats {
+		size_t size{0}; // sessions in the pool, 0 if the pool was not opened yet
+		size_t leased{0}; // sessions in use right now
+		size_t peak{0}; // max sessions in use at once
+		uint64_t leases{0}; // sessions handed out
+		uint64_t timeouts{0}; // lease attempts which gave up waiting
+		uint64_t waitTotalUs{0}; // time spent waiting for a free session
+		uint64_t waitMaxUs{0}; // longest wait for a free session
+	};
+
 	class PayloadAdapterDb : public IPayloadAdapter {
 		public:
 			PayloadAdapterDb();
@@ -23,6 +47,10 @@ namespace CDB {
 			Result<SPayloadPtr_t> getPayload( const std::string& path, const std::vector<std::string>& flavors,
 				 const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime = 0, int64_t eventTime = 0, int64_t run = 0, int64_t seq = 0 ) override;
 
+			// PREFETCH API:
+			PayloadList_t prefetchPayloads( const std::set<std::string>& paths, const std::vector<std::string>& flavors,
+				const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t rangeBegin, int64_t rangeEnd, bool byRun ) override;
+
 			// SET API:
 			Result<SPayloadPtr_t> prepareUpload( const std::string& path ) override;
 			Result<std::string> setPayload( const SPayloadPtr_t& payload ) override;
@@ -49,41 +77,177 @@ namespace CDB {
 			Result<bool> dropDatabaseTables();
 			std::vector<std::string> listDatabaseTables();
 			std::vector<std::string> getTags( bool skipStructs = false );
+			// moves base64 rows of cdb_data_<tbname> (all tables if empty) into the binary bdata column, adding the column if needed;
+			// returns the number of rows moved
+			Result<size_t> migrateDataToBlob( const std::string& tbname = "" );
+
+			// OTHER
+			DbPoolStats poolStats( const std::string& mode );
+			// picks up tags and schemas changed since the last sync, full = reload everything;
+			// safe next to running lookups, which finish on the tags they started with
+			bool refreshMetadata( bool full = false );
 
 		private:
 			// access
-			const std::string& getAccessMode() { return mAccessMode; }
-			bool setAccessMode( const std::string& mode );
 			bool hasAccess(const std::string& a ) {
 				return mConfig["adapters"]["db"].contains( a )
 					&& mConfig["adapters"]["db"][a].is_array()
 					&& mConfig["adapters"]["db"][a].size() > 0;
 			}
 
+			// prepared IOV lookup bound to its own input and output variables, reused across calls
+			enum class IovQuery { ByRun, ByTime, ByTimeWithEnd, EndTime };
+			struct IovStatement {
+				IovStatement( soci::session& session ) : st(session) {}
+				soci::statement st;
+				// inputs
+				std::string flavor{};
+				int64_t eventTime{0}, eventRun{0}, eventSeq{0}, maxEntryTime{0};
+				// outputs
+				std::string id{}, uri{}, fmt{};
+				uint64_t bt{0}, et{0}, ct{0}, dt{0}, run{0}, seq{0};
+				uint64_t nbt{0}; // beginTime of the next payload, ByTimeWithEnd only
+				soci::indicator nbtInd{soci::i_null};
+			};
+			using IovStatementCache_t = std::unordered_map<std::string, std::unique_ptr<IovStatement>>; // "tbname:query:has_mt" => statement
+
+			// sessions of a single access mode, opened on first use
+			struct SessionPool {
+				SessionPool( size_t size, int timeout, size_t servers_configured )
+					: pool(size), statements(size), dbtypes(size), servers(size, 0), timeoutMs(timeout), balancer(servers_configured) {}
+				soci::connection_pool pool;
+				std::vector<IovStatementCache_t> statements; // per session, declared after the pool to be destroyed before it
+				std::vector<std::string> dbtypes; // per session
+				std::vector<size_t> servers; // per session, index of the configured server it is connected to
+				int timeoutMs;
+				LoadBalancer balancer; // steers new connections by connect and query latencies of the servers
+				std::atomic<size_t> leased{0};
+				std::atomic<size_t> peak{0};
+				std::atomic<uint64_t> leases{0};
+				std::atomic<uint64_t> timeouts{0};
+				std::atomic<uint64_t> waitTotalUs{0};
+				std::atomic<uint64_t> waitMaxUs{0};
+			};
+
+			// pooled session, given back to the pool when the lease goes out of scope
+			class SessionLease {
+				public:
+					SessionLease() = default;
+					SessionLease( SessionPool* pool, size_t pos ) : mPool(pool), mPos(pos) {}
+					SessionLease( SessionLease&& other ) noexcept : mPool(other.mPool), mPos(other.mPos) { other.mPool = nullptr; }
+					SessionLease( const SessionLease& ) = delete;
+					SessionLease& operator=( const SessionLease& ) = delete;
+					SessionLease& operator=( SessionLease&& ) = delete;
+					~SessionLease();
+
+					explicit operator bool() const { return mPool != nullptr; }
+					soci::session& operator*() { return mPool->pool.at( mPos ); }
+					soci::session* operator->() { return &mPool->pool.at( mPos ); }
+					const std::string& dbtype() const { return mPool->dbtypes[ mPos ]; }
+					IovStatementCache_t& statements() { return mPool->statements[ mPos ]; }
+					SessionPool* pool() { return mPool; }
+					size_t pos() const { return mPos; }
+
+				private:
+					SessionPool* mPool{nullptr};
+					size_t mPos{0};
+			};
+
+			static constexpr std::array<const char*, 3> ACCESS_MODES{ "get", "set", "admin" };
+			static int accessModeIndex( const std::string& mode );
+
 			// connection
-			bool connect( const std::string& dbtype, const std::string& host, int port,
-					const std::string& user, const std::string& pass, const std::string& dbname, const std::string& options );
-			void disconnect();
-			bool reconnect();
-			bool isConnected() { return mIsConnected; }
-			bool ensureConnection() { if ( isConnected() ) { return true; }; return reconnect(); }
+			SessionPool* ensurePool( const std::string& mode );
+			SessionLease leaseSession( const std::string& mode );
+			bool openSession( SessionPool& pool, size_t pos, const std::string& mode ); // best server first, the others on failure
+			// feeds query latency to the balancer, a session which lost its connection is reopened
+			void reportQuery( SessionLease& session, const std::string& mode, std::chrono::steady_clock::time_point start, bool ok );
+			std::pair<std::string,std::string> connectString( const nlohmann::json& node ); // dbtype, connect string
+
+			std::set<std::string> unfoldPaths( const TagSnapshot& snapshot, const std::set<std::string>& paths ); // directories => all structs below them
+
+			// batched IOV lookups
+			struct IovLookup {
+				std::string path{};
+				std::string directory{};
+				std::string structName{};
+				std::string tbname{};
+				std::string pid{};
+				std::vector<std::string> flavors{}; // in order of preference
+				int64_t mode{0};
+				int64_t maxEntryTime{0};
+				// best match so far
+				size_t flavorIdx{0};
+				bool found{false};
+				bool fallback{false}; // resolve with getPayload instead
+				std::string id{}, uri{}, fmt{};
+				uint64_t bt{0}, et{0}, ct{0}, dt{0}, run{0}, seq{0};
+			};
+			PayloadResults_t getPayloadsBatched( const TagSnapshot& snapshot, const std::set<std::string>& paths, const std::vector<std::string>& flavors,
+				const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq );
+			Result<bool> resolveIovBatch( std::vector<IovLookup>& lookups, const std::vector<size_t>& batch, int64_t eventTime, int64_t run, int64_t seq );
+			Result<bool> resolveEndTimeBatch( std::vector<IovLookup>& lookups, const std::vector<size_t>& batch, int64_t eventTime );
+			size_t batchSize();
+			bool singleQueryIov( const std::string& dbtype );
+			IovStatement& iovStatement( SessionLease& session, const std::string& tbname, IovQuery query, bool has_mt );
 
 			// metadata
 			bool ensureMetadata();
-			bool downloadMetadata(); // download tags and schemas into internal maps
+			STagSnapshotPtr_t tagSnapshot() const { return std::atomic_load( &mTagSnapshot ); } // current tags and paths
+			bool downloadMetadata(); // snapshot, if configured, plus changes since, into internal maps
+			bool syncMetadata( bool full ); // mMetadataMutex must be held
+			Result<bool> fetchMetadata( int64_t since ); // rows changed at or after since, all rows for 0
+			std::string metadataSnapshotPath();
+			std::string metadataSource(); // identifies the servers a snapshot was taken from
 
 			Result<bool> createIOVDataTables( const std::string& tablename, bool create_storage = true );
+
+			// payload data storage: binary bdata column where the backend has a plain blob type, base64 text in data otherwise
+			static bool blobStorage( const std::string& dbtype ); // sqlite3 and mysql, postgresql blobs are large objects
+			bool hasBlobColumn( SessionLease& session, const std::string& tbname ); // cached per table
+			void addBlobColumn( SessionLease& session, const std::string& tbname );
+			// bdata is exchanged through soci::blob on sqlite3; SOCI's mysql backend has no blob support, a length-safe string does there
+			template<typename F> void bindBlob( SessionLease& session, std::string_view bytes, F&& execute ) {
+				if ( session.dbtype() == "sqlite3" ) {
+					soci::blob bdata( *session );
+					if ( bytes.size() ) { bdata.write_from_start( bytes.data(), bytes.size() ); }
+					execute( bdata );
+				} else {
+					std::string data( bytes ); // soci binds strings, not views
+					execute( data );
+				}
+			}
+			template<typename F> std::string fetchBlob( SessionLease& session, F&& execute ) {
+				std::string bytes{};
+				soci::indicator ind{soci::i_null};
+				if ( session.dbtype() == "sqlite3" ) {
+					soci::blob bdata( *session );
+					execute( bdata, ind );
+					if ( ind == soci::i_ok && bdata.get_len() ) {
+						bytes.resize( bdata.get_len() );
+						bytes.resize( bdata.read_from_start( &bytes[0], bytes.size() ) );
+					}
+				} else {
+					execute( bytes, ind );
+					if ( ind != soci::i_ok ) { bytes.clear(); }
+				}
+				return bytes;
+			}
 			Result<std::string> createTag( const std::string& tag_id, const std::string& tag_name, const std::string& tag_pid = "",
 					const std::string& tag_tbname = "", int64_t tag_ct = 0, int64_t tag_dt = 0, int64_t tag_mode = 0 );
 
-			bool mIsConnected{false};
-			std::string mAccessMode{"get"};
-			std::string mDbType{};
-
 			std::atomic<bool> mMetadataAvailable{false};
-			IdToTag_t mTags{};
-			PathToTag_t mPaths{};
-			std::shared_ptr<soci::session> mSession;
+			STagSnapshotPtr_t mTagSnapshot{ std::make_shared<const TagSnapshot>() }; // replaced as a whole, with atomic_store
+			TagMetadata mMetadata{}; // rows behind mTagSnapshot
+			std::mutex mMetadataMutex{}; // protects metadata download and mMetadata
+
+			std::unordered_map<std::string, bool> mBlobColumns{}; // tbname => cdb_data_<tbname> has bdata
+			std::mutex mBlobMutex{}; // protects mBlobColumns
+
+			// SOCI sessions are not thread-safe, every session is used by one lease holder at a time
+			std::array<std::unique_ptr<SessionPool>, ACCESS_MODES.size()> mPools{};
+			std::array<std::atomic<SessionPool*>, ACCESS_MODES.size()> mPoolPtrs{}; // published pools, read without locking
+			std::mutex mPoolMutex{}; // protects pool creation
 	};
 
 } // namespace CDB
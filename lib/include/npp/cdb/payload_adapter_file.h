@@ -1,5 +1,12 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <set>
+#include <shared_mutex>
+#include <string>
+
 #include "npp/cdb/i_payload_adapter.h"
 
 namespace NPP {
@@ -41,9 +48,24 @@ namespace CDB {
 
 			// UTILITY API:
 			Result<std::string> downloadData( const std::string& uri ) override;
+			// data of the uri without a copy: files of at least mmap_min_size bytes are mapped, smaller ones are read
+			Result<SharedBuffer> mapData( const std::string& uri );
 
 		private:
 			DecodedFileNameTuple decodeFilename( const std::string& filename );
+
+			// struct directories (leaves) relative to root, sorted so that the structs below a directory are adjacent;
+			// rebuilt after writes through this adapter and, for other writers, once older than index_ttl_seconds
+			const std::set<std::string>& structIndex( const std::string& root ); // mIndexMutex must be held
+			void invalidateIndex() { ++mIndexGeneration; }
+
+			std::shared_mutex mFileMutex{}; // protects files under dirname
+			std::set<std::string> mStructIndex{};
+			std::string mIndexRoot{};
+			std::chrono::steady_clock::time_point mIndexBuilt{};
+			uint64_t mIndexBuiltGeneration{0};
+			std::atomic<uint64_t> mIndexGeneration{1}; // bumped by writers, an index of an older generation is stale
+			std::mutex mIndexMutex{}; // protects mStructIndex, mIndexRoot, mIndexBuilt, mIndexBuiltGeneration
 	};
 
 } // namespace CDB
@@ -1,15 +1,26 @@
 #pragma once
 
 #include <atomic>
+#include <ctime>
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include <nlohmann/json.hpp>
 
 #include "npp/cdb/http_client.h"
+#include "npp/cdb/http_disk_cache.h"
 #include "npp/cdb/i_payload_adapter.h"
 #include "npp/cdb/tag.h"
+#include "npp/cdb/tag_metadata.h"
+
+#include "npp/util/circuit_breaker.h"
+#include "npp/util/load_balancer.h"
+#include "npp/util/rng.h"
 
 namespace NPP {
 namespace CDB {
@@ -47,6 +58,10 @@ namespace CDB {
 
 			// UTILITY API:
 			Result<std::string> downloadData( const std::string& uri ) override; // GET
+			Result<std::string> downloadData( const std::string& uri, const std::string& id ); // GET, disk cache entries are keyed by payload id and uri
+			// concurrent GETs, results in the order of uris; ids, if given, are the payload ids of uris
+			std::vector<Result<std::string>> downloadDataMany( const std::vector<std::string>& uris, const std::vector<std::string>& ids = {} );
+			void setConfig( nlohmann::json config ) override;
 
 			// ADAPTER-SPECIFIC ADMIN API:
 			Result<bool> createDatabaseTables(); // POST
@@ -63,19 +78,68 @@ namespace CDB {
 					&& mConfig["adapters"]["http"][a].size() > 0;
 			}
       bool ensureMetadata();
-			bool downloadMetadata();
+			bool downloadMetadata(); // snapshot, if configured, plus changes since, GET
+			// picks up tags and schemas changed since the last sync, full = reload everything;
+			// safe next to running lookups, which finish on the tags they started with
+			bool refreshMetadata( bool full = false );
 			std::string generateJWT( const std::string& access = "get", uint64_t idx = 0 );
 
 		private:
+			// all paths in one POST to /payloads_get/, invalid if the server cannot do it
+			Result<PayloadResults_t> getPayloadsBulk( const TagSnapshot& snapshot, const std::set<std::string>& paths, const std::vector<std::string>& flavors,
+				const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq );
+			// one GET per struct and flavor, up to max_concurrent_requests in flight
+			PayloadResults_t getPayloadsConcurrent( const TagSnapshot& snapshot, const std::set<std::string>& paths, const std::vector<std::string>& flavors,
+				const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq );
+			// maxEntryTime in the past: answers can no longer change, so their GET urls may be cached anywhere
+			static bool pinnedMaxEntryTime( int64_t maxEntryTime ) { return maxEntryTime > 0 && maxEntryTime <= std::time(nullptr); }
+			static std::string payloadGetParams( const std::string& tbname, const std::string& flavor, int64_t mode, int64_t maxEntryTime,
+				int64_t eventTime, int64_t run, int64_t seq );
+			// server = index of the "get" server which answered, db:// data is downloaded from it
+			SPayloadPtr_t payloadFromReply( const nlohmann::json& item, const std::string& structName, const std::string& directory, const std::string& tbname,
+				size_t server );
+			bool bulkGet();
+
+			STagSnapshotPtr_t tagSnapshot() const { return std::atomic_load( &mTagSnapshot ); } // current tags and paths
+			bool syncMetadata( bool full ); // mMetadataMutex must be held
+			Result<bool> fetchMetadata( int64_t since ); // rows changed at or after since, all rows for 0
+			std::string metadataSnapshotPath();
+			std::string metadataSource(); // identifies the servers a snapshot was taken from
+
 			void setHttpConfig();
+			// calls attempt( server index, base url ) for the servers of an access mode, load balancer pick first, until it returns true;
+			// servers whose circuit breaker is open are skipped, unless all of them are
+			void forEachServer( const std::string& access, const std::function<bool( size_t, const std::string& )>& attempt );
+			// server of an access mode whose url is the longest prefix of url, 0 if there is none; requests are signed with its credentials
+			size_t serverIndex( const std::string& access, const std::string& url );
+			std::shared_ptr<LoadBalancer> loadBalancer( const std::string& access );
+			std::shared_ptr<CircuitBreaker> circuitBreaker( const std::string& base_url );
+			// tries the servers in turn while they fail for transient reasons
+			HttpResponse requestWithFailover( const std::string& access, bool idempotent,
+				const std::function<HttpResponse( const std::string&, const std::string& )>& request ); // request( base url, token )
 			HttpResponse makeGetRequest(  const std::string& access, const std::string& url );
-			HttpResponse makePostRequest( const std::string& access, const std::string& url, const HttpPostParams_t& params );
+			HttpResponse makePostRequest( const std::string& access, const std::string& url, const HttpPostParams_t& params, bool idempotent = false );
 
 			std::atomic<bool> mMetadataAvailable{false};
-      IdToTag_t mTags{};
-      PathToTag_t mPaths{};
+			std::atomic<bool> mBulkUnsupported{false}; // server has no bulk endpoint, do not ask again
+			std::atomic<bool> mCompressedUnsupported{false}; // server turned compressed data down, upload it uncompressed
+			STagSnapshotPtr_t mTagSnapshot{ std::make_shared<const TagSnapshot>() }; // replaced as a whole, with atomic_store
 
 			HttpClientPtr_t mHttpClient{nullptr};
+			HttpDiskCachePtr_t mDiskCache{nullptr}; // optional, set up from config
+
+			TagMetadata mMetadata{}; // rows behind mTagSnapshot
+			std::mutex mMetadataMutex{}; // protects metadata download and mMetadata
+			std::mutex mRequestMutex{}; // protects mHttpClient settings, mBreakers and mBalancers, requests themselves run unlocked
+			std::unordered_map<std::string, std::shared_ptr<CircuitBreaker>> mBreakers{}; // by server url
+			std::unordered_map<std::string, std::shared_ptr<LoadBalancer>> mBalancers{}; // by access mode, endpoints are server indices
+			unsigned int mBreakerFailures{5};
+			long mBreakerOpenMs{30000};
+
+			// signed tokens are reused until close to expiration, but always outlive the retries of a request
+			std::unordered_map<std::string, std::pair<std::string, int64_t>> mJwtCache{}; // "access:idx" => token, expiration time
+			std::atomic<int64_t> mJwtExpirationSeconds{10};
+			std::mutex mJwtMutex{}; // protects mJwtCache
 	};
 
 } // namespace CDB
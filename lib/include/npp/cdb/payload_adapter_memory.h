@@ -1,10 +1,16 @@
 #pragma once
 
-#include <deque>
+#include <array>
+#include <atomic>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "npp/cdb/i_payload_adapter.h"
+#include "npp/cdb/cache_eviction_policy.h"
 
 #define CDBNPP_MEGABYTES 1024*1024
 
@@ -13,10 +19,25 @@ namespace CDB {
 
 	using namespace NPP::Util;
 
+	struct CacheStats {
+		uint64_t hits{0};
+		uint64_t misses{0};
+		uint64_t insertions{0};
+		uint64_t evictions{0};
+		size_t items{0};
+		size_t bytes{0};
+		size_t mapped_bytes{0}; // file mappings, shared with the page cache and not held against the size limits
+	};
+
+	struct CacheInsertion {
+		size_t inserted{0};
+		size_t evicted{0}; // of those inserted, dropped right away to stay within the cache limits
+	};
+
 	class PayloadAdapterMemory : public IPayloadAdapter {
 		public:
 			PayloadAdapterMemory();
-			virtual ~PayloadAdapterMemory() = default;
+			virtual ~PayloadAdapterMemory();
 
 			// GET API:
 			PayloadResults_t getPayloads( const std::set<std::string>& paths, const std::vector<std::string>& flavors,
@@ -27,6 +48,7 @@ namespace CDB {
 			// SET API:
 			Result<SPayloadPtr_t> prepareUpload( const std::string& path ) override;
 			Result<std::string> setPayload( const SPayloadPtr_t& payload ) override;
+			CacheInsertion setPayloads( const PayloadList_t& payloads ); // bulk insert, the index is updated once
 
 			// ADMIN API:
 			Result<std::string> deactivatePayload( const SPayloadPtr_t& payload, int64_t deactiveTime ) override;
@@ -46,16 +68,104 @@ namespace CDB {
 			Result<std::string> downloadData( const std::string& uri ) override;
 
 			// OTHER
-			size_t cacheSize() { return mCacheSizeBytes; }
-			size_t cacheItemCount() { return mCache.size(); }
+			size_t cacheSize() { return mCacheSizeBytes.load( std::memory_order_relaxed ); }
+			size_t cacheMappedSize() { return mCacheMappedBytes.load( std::memory_order_relaxed ); }
+			size_t cacheItemCount() { return mCacheItemCount.load( std::memory_order_relaxed ); }
 			void setCacheSizeLimit( size_t lo, size_t hi ) { mCacheSizeLimitLo = lo; mCacheSizeLimitHi = hi; }
-			void setCacheItemLimit( size_t lo, size_t hi ) { mCacheItemLimitLo = lo; mCacheSizeLimitHi = hi; }
+			void setCacheItemLimit( size_t lo, size_t hi ) { mCacheItemLimitLo = lo; mCacheItemLimitHi = hi; }
+			bool setEvictionPolicy( const std::string& policy_id );
+			std::string evictionPolicy();
+			CacheStats cacheStats();
+			void updatePayloadSize( const SPayloadPtr_t& payload ); // recounts a cached payload after its data was set
+			void resetCacheStats();
 
 		private:
-			bool maintainCacheWithinLimits();
-
-			std::deque<SPayloadPtr_t> mCache{};
-			size_t mCacheSizeBytes{0};
+			using RunSeq_t = std::pair<int64_t,int64_t>;
+
+			struct RunSeqHash {
+				size_t operator()( const RunSeq_t& rs ) const noexcept {
+					return std::hash<uint64_t>{}( static_cast<uint64_t>( rs.first ) * 0x9e3779b97f4a7c15ULL ^ static_cast<uint64_t>( rs.second ) );
+				}
+			};
+
+			// cached payload with usage counters, readers bump the counters of the entry they hit
+			struct CacheEntry {
+				CacheEntry( const SPayloadPtr_t& p, uint64_t tick ) : payload(p), inserted(tick), accessed(tick) {}
+				SPayloadPtr_t payload;
+				uint64_t inserted;
+				std::atomic<uint64_t> accessed;
+				std::atomic<uint64_t> hits{0};
+				size_t bytes{0}; // as counted into the cache totals, writers only
+				size_t mappedBytes{0};
+			};
+			using SCacheEntryPtr_t = std::shared_ptr<CacheEntry>;
+
+			// interval entry; maxEndTime is the largest endTime of this and all earlier slots, so a lookup walking
+			// backwards from the event time stops as soon as nothing before it can cover the event
+			struct TimeSlot {
+				int64_t beginTime;
+				int64_t endTime;
+				int64_t maxEndTime;
+				SCacheEntryPtr_t entry;
+			};
+
+			// all cached payloads of a single flavor:directory/structName, immutable once published
+			struct CacheBucket {
+				std::vector<TimeSlot> byTime{}; // mode = 1, sorted by beginTime
+				std::unordered_multimap<RunSeq_t, SCacheEntryPtr_t, RunSeqHash> byRun{}; // mode = 2, (run,seq) => entry
+			};
+			using ShardMap_t = std::unordered_map<std::string, std::shared_ptr<const CacheBucket>>; // "flavor:directory/structName" => bucket
+
+			// readers load the current map with a plain atomic load, writers publish a modified copy and retire
+			// the replaced one until no reader can still be looking at it
+			static constexpr size_t CACHE_SHARDS = 32;
+			struct alignas(64) CacheShard {
+				std::atomic<const ShardMap_t*> map{ new ShardMap_t() };
+			};
+			struct RetiredMap {
+				const ShardMap_t* map;
+				uint64_t epoch; // mEpoch when it was replaced
+			};
+
+			// one per reading thread: the epoch it entered a lookup in, or 0 outside of one; its own hit and miss
+			// counters, so that lookups never write to a cache line shared with other threads
+			struct alignas(64) ReaderSlot {
+				std::atomic<uint64_t> epoch{0};
+				std::atomic<uint64_t> hits{0};
+				std::atomic<uint64_t> misses{0};
+				std::atomic<bool> used{true}; // cleared when its thread exits, the slot then goes to another one
+			};
+			using SReaderSlotPtr_t = std::shared_ptr<ReaderSlot>;
+
+			static std::string cacheKey( const std::string& flavor, const std::string& directory, const std::string& structName ) {
+				return flavor + ":" + directory + "/" + structName;
+			}
+			// all flavors of a struct share a shard
+			static size_t shardIndex( const std::string& directory, const std::string& structName ) {
+				return std::hash<std::string>{}( directory + "/" + structName ) % CACHE_SHARDS;
+			}
+
+			void updateIndex( const std::vector<SCacheEntryPtr_t>& added, const std::vector<SCacheEntryPtr_t>& removed ); // expects mWriteMutex to be held
+			bool maintainCacheWithinLimits(); // expects mWriteMutex to be held by the caller
+			void countEntry( CacheEntry& entry ); // expects mWriteMutex to be held by the caller
+			void reclaimRetired(); // expects mWriteMutex to be held by the caller
+			ReaderSlot& readerSlot(); // of the calling thread, registered on its first lookup
+
+			std::array<CacheShard, CACHE_SHARDS> mShards{};
+			std::mutex mWriteMutex{}; // serializes writers only, lookups take no lock
+			std::atomic<uint64_t> mEpoch{1}; // bumped by every map a writer replaces
+			std::vector<RetiredMap> mRetired{}; // writers only
+			std::vector<SReaderSlotPtr_t> mReaders{}; // protected by mReadersMutex
+			std::mutex mReadersMutex{}; // taken once per thread to register, and by writers reclaiming maps
+			const uint64_t mInstance; // never reused, tells adapters apart in per-thread slot lists
+			std::unordered_map<const Payload*, SCacheEntryPtr_t> mEntries{}; // all cached entries, writers only
+			ICacheEvictionPolicyPtr_t mEvictionPolicy{ std::make_shared<CacheEvictionPolicyLru>() };
+			std::atomic<uint64_t> mTick{0}; // logical clock, advanced by insertions and by hits
+			std::atomic<uint64_t> mInsertions{0};
+			std::atomic<uint64_t> mEvictions{0};
+			std::atomic<size_t> mCacheSizeBytes{0}; // heap only, limited by mCacheSizeLimitLo/Hi
+			std::atomic<size_t> mCacheMappedBytes{0};
+			std::atomic<size_t> mCacheItemCount{0};
 			size_t mCacheSizeLimitLo{ 50 * CDBNPP_MEGABYTES};
 			size_t mCacheSizeLimitHi{100 * CDBNPP_MEGABYTES};
 			size_t mCacheItemLimitLo{ 5000};
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <algorithm>
 #include <ctime>
+#include <future>
 #include <memory>
 #include <set>
 #include <string>
@@ -11,6 +13,7 @@
 
 #include "npp/util/result.h"
 #include "npp/util/singleton.h"
+#include "npp/util/thread_pool.h"
 
 #include "npp/cdb/i_payload_adapter.h"
 #include "npp/cdb/payload.h"
@@ -22,16 +25,29 @@ namespace CDB {
 	class Service;
 
 	using ServiceS = Singleton<Service, CreateMeyers>;
+	using PayloadFutures_t = std::unordered_map<std::string, std::future<Result<SPayloadPtr_t>>>;
 
 	class Service {
 		public:
 			Service() = default;
+			explicit Service( const nlohmann::json& cfg ) : mConfig(cfg) {}
 			~Service() = default;
 
+			// every instance owns its adapters and their locks, copies would silently share them
+			Service( const Service& ) = delete;
+			Service& operator=( const Service& ) = delete;
+
 			void init( const std::string& adapters = "memory+file+db+http" );
 
 			// GET API:
 			PayloadResults_t getPayloads( const std::set<std::string>& paths, bool fetch_data = true );
+			// IOVs are resolved right away, each future is ready once the payload data is downloaded
+			PayloadFutures_t getPayloadsAsync( const std::set<std::string>& paths );
+
+			// PREFETCH API: caches every payload valid within the range in the memory adapter, returns the number
+			// still cached once the cache limits applied
+			Result<size_t> prefetch( const std::set<std::string>& paths, int64_t beginTime, int64_t endTime );
+			Result<size_t> prefetchByRun( const std::set<std::string>& paths, int64_t runBegin, int64_t runEnd );
 
 			// SET API:
 			Result<SPayloadPtr_t> prepareUpload( const std::string& path ); // new upload
@@ -74,10 +90,11 @@ namespace CDB {
 			void setConfig( const std::string& cfg ) { mConfig = nlohmann::json::parse(cfg,nullptr,false,true); }
 			void setConfig( const nlohmann::json& cfg ) { mConfig = cfg; }
 
-			bool isEnabledMemory() { return mPayloadAdapterMemory != nullptr; }
-			bool isEnabledFile() { return mPayloadAdapterFile != nullptr; }
-			bool isEnabledDb() { return mPayloadAdapterDb != nullptr; }
-			bool isEnabledHttp() { return mPayloadAdapterHttp != nullptr; }
+			// all adapters are constructed by init(), only those it was asked for are enabled
+			bool isEnabledMemory() { return isEnabled( mPayloadAdapterMemory ); }
+			bool isEnabledFile() { return isEnabled( mPayloadAdapterFile ); }
+			bool isEnabledDb() { return isEnabled( mPayloadAdapterDb ); }
+			bool isEnabledHttp() { return isEnabled( mPayloadAdapterHttp ); }
 			std::vector<std::string> enabledAdapters();
 
 			IPayloadAdapterPtr_t& getPayloadAdapterMemory() { return mPayloadAdapterMemory; }
@@ -89,6 +106,12 @@ namespace CDB {
 
 		private:
 			Result<bool> validateConfigFile();
+			bool isEnabled( const IPayloadAdapterPtr_t& adapter ) const {
+				return adapter && std::find( mEnabledAdapters.begin(), mEnabledAdapters.end(), adapter ) != mEnabledAdapters.end();
+			}
+			void compressPayload( const SPayloadPtr_t& payload ); // applies service.compression from the config
+			void updateCachedSize( const SPayloadPtr_t& payload ); // after data was set on a payload the memory adapter may hold
+			Result<size_t> prefetchRange( const std::set<std::string>& paths, int64_t rangeBegin, int64_t rangeEnd, bool byRun );
 
 			int64_t mEventTime{0};
 			int64_t mMaxEntryTime{0};
@@ -104,6 +127,9 @@ namespace CDB {
 
 			std::vector<IPayloadAdapterPtr_t> mEnabledAdapters{};
 
+			// data downloads, declared after the adapters so that queued downloads finish before they go away
+			std::unique_ptr<ThreadPool> mFetchPool{ std::make_unique<ThreadPool>(0) };
+
 			nlohmann::json mConfig{};
 	};
 
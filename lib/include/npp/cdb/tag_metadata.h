@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
+#include <nlohmann/json.hpp>
+
+#include "npp/cdb/tag.h"
+
+namespace NPP {
+namespace CDB {
+
+	// tag rows as listed by cdb_tags joined with cdb_schemas: id, name, pid, tbname, ct, dt, mode, schema_id, schema_ct
+	using TagRows_t = std::unordered_map<std::string, nlohmann::json>; // tag id => row
+
+	// tags and paths built from one state of the rows, never changed once published: lookups hold on to the
+	// snapshot they started with, refreshes build the next one aside and swap it in
+	struct TagSnapshot {
+		IdToTag_t tags{};
+		PathToTag_t paths{};
+	};
+	using STagSnapshotPtr_t = std::shared_ptr<const TagSnapshot>;
+
+	// local copy of the tag metadata, kept up to date by delta refreshes: rows with ct, dt or schema_ct at or after
+	// the last sync replace the ones already known, and the whole copy can be stored to disk for warm restarts
+	struct TagMetadata {
+		TagRows_t rows{};
+		int64_t synced{0}; // latest ct, dt or schema_ct seen, 0 if nothing is known yet
+
+		size_t merge( const nlohmann::json& tags ); // array of rows, returns the number of rows merged
+		void add( const STagPtr_t& tag ); // tag created locally
+		size_t schemas() const; // rows with a schema attached
+		size_t deactivated() const; // rows with dt set
+		STagSnapshotPtr_t build() const; // fresh Tag objects, orphans left out
+		void clear();
+
+		// snapshot file, ignored if written for another source (set of servers)
+		bool load( const std::string& file, const std::string& source );
+		bool save( const std::string& file, const std::string& source ) const;
+	};
+
+} // namespace CDB
+} // namespace NPP
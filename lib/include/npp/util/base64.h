@@ -24,14 +24,98 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <cstdint>
 #include <string>
+#include <string_view>
+
+#if ( defined(__x86_64__) || defined(__i386__) ) && ( defined(__GNUC__) || defined(__clang__) ) && __has_include(<immintrin.h>)
+#include <immintrin.h>
+#define CDBNPP_BASE64_X86 1
+#endif
 
 namespace NPP {
 namespace Util {
 
+	// encode/decode pick the widest implementation the cpu supports at runtime: AVX2, SSE4.1 or the scalar tables;
+	// the vector loops cover whole blocks of valid input, tails, padding and malformed input go through the scalar code
 	class base64 {
 		public:
-			static std::string encode(const std::string& data) {
+			enum class Impl { Scalar, Sse41, Avx2 };
+
+			static std::string encode( std::string_view data ) { return encode( data, best() ); }
+			static std::string decode( std::string_view input ) { return decode( input, best() ); }
+
+			static std::string encode( std::string_view data, Impl impl ) {
+				size_t in_len = data.size();
+				std::string ret( 4 * ( ( in_len + 2 ) / 3 ), '\0' );
+				const char* src = data.data();
+				char* p = &ret[0];
+				size_t i = 0;
+#ifdef CDBNPP_BASE64_X86
+				if ( impl == Impl::Avx2 ) {
+					i = encodeAvx2( src, in_len, p );
+				} else if ( impl == Impl::Sse41 ) {
+					i = encodeSse41( src, in_len, p );
+				}
+				p += i / 3 * 4;
+#else
+				(void)impl;
+#endif
+				encodeScalar( src + i, in_len - i, p );
+				return ret;
+			}
+
+			static std::string decode( std::string_view input, Impl impl ) {
+				size_t in_len = input.size();
+				if ( in_len == 0 ) return "";
+				if (in_len % 4 != 0) return "Input data size is not a multiple of 4";
+
+				size_t out_len = in_len / 4 * 3;
+				if (input[in_len - 1] == '=') out_len--;
+				if (input[in_len - 2] == '=') out_len--;
+
+				std::string out;
+				out.resize(out_len);
+
+				size_t i = 0;
+#ifdef CDBNPP_BASE64_X86
+				// the last quartet may carry padding, it is always left to the scalar code
+				if ( impl == Impl::Avx2 ) {
+					i = decodeAvx2( input.data(), in_len - 4, &out[0], out_len );
+				} else if ( impl == Impl::Sse41 ) {
+					i = decodeSse41( input.data(), in_len - 4, &out[0], out_len );
+				}
+#else
+				(void)impl;
+#endif
+				decodeScalar( input.data(), i, in_len, &out[0], i / 4 * 3, out_len );
+				return out;
+			}
+
+			static Impl best() {
+				static const Impl impl = detect();
+				return impl;
+			}
+
+			static bool supported( Impl impl ) {
+				return impl == Impl::Scalar || ( impl == Impl::Sse41 && best() != Impl::Scalar ) || ( impl == Impl::Avx2 && best() == Impl::Avx2 );
+			}
+
+			static const char* name( Impl impl ) {
+				return impl == Impl::Avx2 ? "avx2" : ( impl == Impl::Sse41 ? "sse4.1" : "scalar" );
+			}
+
+		private:
+			static Impl detect() {
+#ifdef CDBNPP_BASE64_X86
+				__builtin_cpu_init();
+				if ( __builtin_cpu_supports("avx2") ) { return Impl::Avx2; }
+				if ( __builtin_cpu_supports("sse4.1") ) { return Impl::Sse41; }
+#endif
+				return Impl::Scalar;
+			}
+
+			static void encodeScalar( const char* data, size_t in_len, char* p ) {
 				static constexpr char sEncodingTable[] = {
 					'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H',
 					'I', 'J', 'K', 'L', 'M', 'N', 'O', 'P',
@@ -43,13 +127,8 @@ namespace Util {
 					'4', '5', '6', '7', '8', '9', '+', '/'
 				};
 
-				size_t in_len = data.size();
-				size_t out_len = 4 * ((in_len + 2) / 3);
-				std::string ret(out_len, '\0');
 				size_t i;
-				char *p = const_cast<char*>(ret.c_str());
-
-				for (i = 0; i < in_len - 2; i += 3) {
+				for (i = 0; i + 2 < in_len; i += 3) {
 					*p++ = sEncodingTable[(data[i] >> 2) & 0x3F];
 					*p++ = sEncodingTable[((data[i] & 0x3) << 4) | ((int) (data[i + 1] & 0xF0) >> 4)];
 					*p++ = sEncodingTable[((data[i + 1] & 0xF) << 2) | ((int) (data[i + 2] & 0xC0) >> 6)];
@@ -67,11 +146,10 @@ namespace Util {
 					}
 					*p++ = '=';
 				}
-
-				return ret;
 			}
 
-			static std::string decode( const std::string& input ) {
+			// input[i, in_len) into out[j, out_len)
+			static void decodeScalar( const char* input, size_t i, size_t in_len, char* out, size_t j, size_t out_len ) {
 				static constexpr unsigned char kDecodingTable[] = {
 					64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
 					64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64,
@@ -91,21 +169,11 @@ namespace Util {
 					64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64, 64
 				};
 
-				size_t in_len = input.size();
-				if (in_len % 4 != 0) return "Input data size is not a multiple of 4";
-
-				size_t out_len = in_len / 4 * 3;
-				if (input[in_len - 1] == '=') out_len--;
-				if (input[in_len - 2] == '=') out_len--;
-
-				std::string out;
-				out.resize(out_len);
-
-				for (size_t i = 0, j = 0; i < in_len;) {
-					uint32_t a = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<int>(input[i++])];
-					uint32_t b = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<int>(input[i++])];
-					uint32_t c = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<int>(input[i++])];
-					uint32_t d = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<int>(input[i++])];
+				while (i < in_len) {
+					uint32_t a = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<unsigned char>(input[i++])];
+					uint32_t b = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<unsigned char>(input[i++])];
+					uint32_t c = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<unsigned char>(input[i++])];
+					uint32_t d = input[i] == '=' ? 0 & i++ : kDecodingTable[static_cast<unsigned char>(input[i++])];
 
 					uint32_t triple = (a << 3 * 6) + (b << 2 * 6) + (c << 1 * 6) + (d << 0 * 6);
 
@@ -113,9 +181,118 @@ namespace Util {
 					if (j < out_len) out[j++] = (triple >> 1 * 8) & 0xFF;
 					if (j < out_len) out[j++] = (triple >> 0 * 8) & 0xFF;
 				}
+			}
 
-				return out;
+#ifdef CDBNPP_BASE64_X86
+			// vector kernels after W. Mula and D. Lemire, "Faster Base64 Encoding and Decoding Using AVX2 Instructions";
+			// they return the number of input bytes consumed, always a multiple of 3 (encode) or 4 (decode)
+
+			// 12 bytes => 16 characters per 128-bit lane
+
+			__attribute__((target("sse4.1"), always_inline)) static inline __m128i encodeLane( __m128i in ) {
+				in = _mm_shuffle_epi8( in, _mm_set_epi8( 10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1 ) );
+				// split 3 bytes into 4 sextets, one per byte
+				const __m128i t0 = _mm_and_si128( in, _mm_set1_epi32( 0x0fc0fc00 ) );
+				const __m128i t1 = _mm_mulhi_epu16( t0, _mm_set1_epi32( 0x04000040 ) );
+				const __m128i t2 = _mm_and_si128( in, _mm_set1_epi32( 0x003f03f0 ) );
+				const __m128i t3 = _mm_mullo_epi16( t2, _mm_set1_epi32( 0x01000010 ) );
+				const __m128i indices = _mm_or_si128( t1, t3 );
+				// sextet => ascii: offset by range, 0..25 => 'A', 26..51 => 'a', 52..61 => '0', 62 => '+', 63 => '/'
+				__m128i range = _mm_subs_epu8( indices, _mm_set1_epi8( 51 ) );
+				const __m128i less = _mm_cmpgt_epi8( _mm_set1_epi8( 26 ), indices );
+				range = _mm_or_si128( range, _mm_and_si128( less, _mm_set1_epi8( 13 ) ) );
+				const __m128i offsets = _mm_setr_epi8( 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+					'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 );
+				return _mm_add_epi8( _mm_shuffle_epi8( offsets, range ), indices );
+			}
+
+			__attribute__((target("avx2"), always_inline)) static inline __m256i encodeLanes( __m256i in ) {
+				in = _mm256_shuffle_epi8( in, _mm256_setr_epi8( 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10,
+					1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10 ) );
+				const __m256i t0 = _mm256_and_si256( in, _mm256_set1_epi32( 0x0fc0fc00 ) );
+				const __m256i t1 = _mm256_mulhi_epu16( t0, _mm256_set1_epi32( 0x04000040 ) );
+				const __m256i t2 = _mm256_and_si256( in, _mm256_set1_epi32( 0x003f03f0 ) );
+				const __m256i t3 = _mm256_mullo_epi16( t2, _mm256_set1_epi32( 0x01000010 ) );
+				const __m256i indices = _mm256_or_si256( t1, t3 );
+				__m256i range = _mm256_subs_epu8( indices, _mm256_set1_epi8( 51 ) );
+				const __m256i less = _mm256_cmpgt_epi8( _mm256_set1_epi8( 26 ), indices );
+				range = _mm256_or_si256( range, _mm256_and_si256( less, _mm256_set1_epi8( 13 ) ) );
+				const __m256i offsets = _mm256_setr_epi8( 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+					'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0,
+					'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+					'0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0 );
+				return _mm256_add_epi8( _mm256_shuffle_epi8( offsets, range ), indices );
+			}
+
+			__attribute__((target("sse4.1"))) static size_t encodeSse41( const char* src, size_t len, char* dst ) {
+				size_t i = 0;
+				// 16 bytes are loaded for 12 used
+				for ( ; i + 16 <= len; i += 12, dst += 16 ) {
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( dst ), encodeLane( _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) ) ) );
+				}
+				return i;
+			}
+
+			__attribute__((target("avx2"))) static size_t encodeAvx2( const char* src, size_t len, char* dst ) {
+				size_t i = 0;
+				// two 16 byte loads, 12 apart, for 24 used
+				for ( ; i + 28 <= len; i += 24, dst += 32 ) {
+					const __m128i lo = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+					const __m128i hi = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i + 12 ) );
+					const __m256i in = _mm256_inserti128_si256( _mm256_castsi128_si256( lo ), hi, 1 );
+					_mm256_storeu_si256( reinterpret_cast<__m256i*>( dst ), encodeLanes( in ) );
+				}
+				return i + encodeSse41( src + i, len - i, dst );
+			}
+
+			// 16 characters => 12 bytes per 128-bit lane; stops at the first block with anything but the 64 characters
+			__attribute__((target("sse4.1"))) static size_t decodeSse41( const char* src, size_t len, char* dst, size_t out_len ) {
+				const __m128i lut_lo = _mm_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A );
+				const __m128i lut_hi = _mm_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+				const __m128i lut_roll = _mm_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+				const __m128i pack = _mm_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+				size_t i = 0, j = 0;
+				// 16 bytes are stored for 12 used
+				for ( ; i + 16 <= len && j + 16 <= out_len; i += 16, j += 12 ) {
+					const __m128i in = _mm_loadu_si128( reinterpret_cast<const __m128i*>( src + i ) );
+					const __m128i hi_nibbles = _mm_and_si128( _mm_srli_epi32( in, 4 ), _mm_set1_epi8( 0x0f ) );
+					const __m128i lo_nibbles = _mm_and_si128( in, _mm_set1_epi8( 0x0f ) );
+					if ( !_mm_testz_si128( _mm_shuffle_epi8( lut_lo, lo_nibbles ), _mm_shuffle_epi8( lut_hi, hi_nibbles ) ) ) { break; }
+					const __m128i eq_2f = _mm_cmpeq_epi8( in, _mm_set1_epi8( '/' ) );
+					const __m128i values = _mm_add_epi8( in, _mm_shuffle_epi8( lut_roll, _mm_add_epi8( eq_2f, hi_nibbles ) ) );
+					// merge 4 sextets into 3 bytes
+					const __m128i merged = _mm_madd_epi16( _mm_maddubs_epi16( values, _mm_set1_epi32( 0x01400140 ) ), _mm_set1_epi32( 0x00011000 ) );
+					_mm_storeu_si128( reinterpret_cast<__m128i*>( dst + j ), _mm_shuffle_epi8( merged, pack ) );
+				}
+				return i;
+			}
+
+			__attribute__((target("avx2"))) static size_t decodeAvx2( const char* src, size_t len, char* dst, size_t out_len ) {
+				const __m256i lut_lo = _mm256_setr_epi8( 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+					0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A );
+				const __m256i lut_hi = _mm256_setr_epi8( 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+					0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10 );
+				const __m256i lut_roll = _mm256_setr_epi8( 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+					0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0 );
+				const __m256i pack = _mm256_setr_epi8( 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+					2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1 );
+				size_t i = 0, j = 0;
+				// 32 bytes are stored for 24 used
+				for ( ; i + 32 <= len && j + 32 <= out_len; i += 32, j += 24 ) {
+					const __m256i in = _mm256_loadu_si256( reinterpret_cast<const __m256i*>( src + i ) );
+					const __m256i hi_nibbles = _mm256_and_si256( _mm256_srli_epi32( in, 4 ), _mm256_set1_epi8( 0x0f ) );
+					const __m256i lo_nibbles = _mm256_and_si256( in, _mm256_set1_epi8( 0x0f ) );
+					if ( !_mm256_testz_si256( _mm256_shuffle_epi8( lut_lo, lo_nibbles ), _mm256_shuffle_epi8( lut_hi, hi_nibbles ) ) ) { break; }
+					const __m256i eq_2f = _mm256_cmpeq_epi8( in, _mm256_set1_epi8( '/' ) );
+					const __m256i values = _mm256_add_epi8( in, _mm256_shuffle_epi8( lut_roll, _mm256_add_epi8( eq_2f, hi_nibbles ) ) );
+					const __m256i merged = _mm256_madd_epi16( _mm256_maddubs_epi16( values, _mm256_set1_epi32( 0x01400140 ) ), _mm256_set1_epi32( 0x00011000 ) );
+					// 12 bytes at the bottom of each lane, close the gap between them
+					const __m256i packed = _mm256_permutevar8x32_epi32( _mm256_shuffle_epi8( merged, pack ), _mm256_setr_epi32( 0, 1, 2, 4, 5, 6, 3, 7 ) );
+					_mm256_storeu_si256( reinterpret_cast<__m256i*>( dst + j ), packed );
+				}
+				return i + decodeSse41( src + i, len - i, dst + j, out_len - j );
 			}
+#endif
 	};
 
 } // namespace Util
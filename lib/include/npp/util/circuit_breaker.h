@@ -0,0 +1,73 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+
+namespace NPP {
+namespace Util {
+
+	// stops traffic to an endpoint after consecutive failures: open for a cool-down period,
+	// then half-open with a single trial request which closes it again on success
+	class CircuitBreaker {
+		public:
+			enum class State { Closed, Open, HalfOpen };
+
+			explicit CircuitBreaker( unsigned int failureThreshold = 5, std::chrono::milliseconds openDuration = std::chrono::seconds(30) )
+				: mFailureThreshold( failureThreshold ? failureThreshold : 1 ), mOpenDuration(openDuration) {}
+
+			CircuitBreaker( const CircuitBreaker& ) = delete;
+			CircuitBreaker& operator=( const CircuitBreaker& ) = delete;
+
+			// true if a request may go out now, the first caller after the cool-down gets the trial request
+			bool allow() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				switch ( mState ) {
+					case State::Closed:
+						return true;
+					case State::Open:
+						if ( Clock_t::now() - mOpenedAt < mOpenDuration ) { return false; }
+						mState = State::HalfOpen;
+						mOpenedAt = Clock_t::now();
+						return true;
+					case State::HalfOpen:
+						// trial request in flight, unless its caller never reported back
+						if ( Clock_t::now() - mOpenedAt < mOpenDuration ) { return false; }
+						mOpenedAt = Clock_t::now();
+						return true;
+				}
+				return true;
+			}
+
+			void recordSuccess() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				mState = State::Closed;
+				mFailures = 0;
+			}
+
+			void recordFailure() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				++mFailures;
+				if ( mState == State::HalfOpen || mFailures >= mFailureThreshold ) {
+					mState = State::Open;
+					mOpenedAt = Clock_t::now();
+				}
+			}
+
+			State state() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return mState;
+			}
+
+		private:
+			using Clock_t = std::chrono::steady_clock;
+
+			std::mutex mMutex{};
+			State mState{State::Closed};
+			unsigned int mFailures{0};
+			unsigned int mFailureThreshold;
+			std::chrono::milliseconds mOpenDuration;
+			Clock_t::time_point mOpenedAt{};
+	};
+
+} // namespace Util
+} // namespace NPP
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "npp/util/result.h"
+
+namespace NPP {
+namespace Util {
+
+	// optional payload codecs, "zstd" and "lz4" (frame format), compiled in when the library is built
+	// with libzstd and/or liblz4 available, see lib/CMakeLists.txt
+	bool codec_known( const std::string& codec );
+	bool codec_available( const std::string& codec );
+	std::vector<std::string> codecs_available();
+
+	std::string codec_file_extension( const std::string& codec ); // zstd => zst, lz4 => lz4
+	std::string codec_from_file_extension( const std::string& extension ); // empty if not a codec extension
+
+	// level 0 picks the codec default
+	Result<std::string> compress( std::string_view data, const std::string& codec, int level = 0 );
+	Result<std::string> decompress( std::string_view data, const std::string& codec );
+
+} // namespace Util
+} // namespace NPP
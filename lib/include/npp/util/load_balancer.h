@@ -0,0 +1,110 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include "npp/util/rng.h"
+
+namespace NPP {
+namespace Util {
+
+	// routes requests over interchangeable endpoints (replicas of a server): keeps an EWMA of latency and error rate
+	// per endpoint and picks with power of two choices, i.e. the cheaper of two random endpoints;
+	// stats not refreshed for a while are forgotten, so an endpoint which recovered gets traffic again
+	class LoadBalancer {
+		public:
+			explicit LoadBalancer( size_t endpoints = 0, double alpha = 0.2, std::chrono::milliseconds staleAfter = std::chrono::seconds(60) )
+				: mStats(endpoints), mAlpha(alpha), mStaleAfter(staleAfter) {}
+
+			LoadBalancer( const LoadBalancer& ) = delete;
+			LoadBalancer& operator=( const LoadBalancer& ) = delete;
+
+			void resize( size_t endpoints ) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				mStats.assign( endpoints, Stats() );
+			}
+
+			size_t size() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return mStats.size();
+			}
+
+			size_t pick() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return pickLocked();
+			}
+
+			// the pick first, then the rest from the cheapest, for failover
+			std::vector<size_t> ranked() {
+				std::lock_guard<std::mutex> lock(mMutex);
+				std::vector<size_t> res;
+				if ( mStats.empty() ) { return res; }
+				size_t first = pickLocked();
+				res.push_back( first );
+				std::vector<std::pair<double, size_t>> rest;
+				for ( size_t i = 0; i < mStats.size(); ++i ) {
+					if ( i != first ) { rest.emplace_back( costLocked(i), i ); }
+				}
+				std::sort( rest.begin(), rest.end() );
+				for ( const auto& [ cost, i ] : rest ) {
+					res.push_back( i );
+				}
+				return res;
+			}
+
+			void record( size_t endpoint, double latencyUs, bool ok ) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				if ( endpoint >= mStats.size() ) { return; }
+				Stats& s = mStats[endpoint];
+				if ( !s.samples || Clock_t::now() - s.updated > mStaleAfter ) {
+					s.latencyUs = latencyUs;
+					s.errorRate = ok ? 0.0 : 1.0;
+				} else {
+					s.latencyUs += mAlpha * ( latencyUs - s.latencyUs );
+					s.errorRate += mAlpha * ( ( ok ? 0.0 : 1.0 ) - s.errorRate );
+				}
+				++s.samples;
+				s.updated = Clock_t::now();
+			}
+
+			double cost( size_t endpoint ) {
+				std::lock_guard<std::mutex> lock(mMutex);
+				return endpoint < mStats.size() ? costLocked( endpoint ) : 0;
+			}
+
+		private:
+			using Clock_t = std::chrono::steady_clock;
+
+			struct Stats {
+				double latencyUs{0};
+				double errorRate{0};
+				uint64_t samples{0};
+				Clock_t::time_point updated{};
+			};
+
+			size_t pickLocked() {
+				if ( mStats.size() < 2 ) { return 0; }
+				size_t a = std::min( mRng.random_inclusive<size_t>( 0, mStats.size() - 1 ), mStats.size() - 1 );
+				size_t b = std::min( mRng.random_inclusive<size_t>( 0, mStats.size() - 2 ), mStats.size() - 2 );
+				if ( b >= a ) { ++b; } // two distinct endpoints
+				return costLocked(b) < costLocked(a) ? b : a;
+			}
+
+			// unknown endpoints cost nothing, so they get probed; errors weigh as twenty times the latency
+			double costLocked( size_t i ) {
+				const Stats& s = mStats[i];
+				if ( !s.samples || Clock_t::now() - s.updated > mStaleAfter ) { return 0; }
+				return ( s.latencyUs + 1.0 ) * ( 1.0 + 20.0 * s.errorRate );
+			}
+
+			std::mutex mMutex{}; // protects everything below
+			std::vector<Stats> mStats;
+			double mAlpha;
+			std::chrono::milliseconds mStaleAfter;
+			Rng mRng{};
+	};
+
+} // namespace Util
+} // namespace NPP
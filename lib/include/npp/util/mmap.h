@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "npp/util/result.h"
+#include "npp/util/shared_buffer.h"
+
+namespace NPP {
+namespace Util {
+
+	// read-only shared mapping of a whole file. Pages come from the page cache, so every process on the node
+	// mapping the same file reads the same physical memory. The mapping outlives unlink or rename of the file,
+	// but not truncation: files must not be rewritten in place while mapped.
+	class MappedFile {
+		public:
+			~MappedFile() {
+				if ( mAddr ) { munmap( mAddr, mSize ); }
+			}
+
+			MappedFile( const MappedFile& ) = delete;
+			MappedFile& operator=( const MappedFile& ) = delete;
+
+			std::string_view view() const { return std::string_view( static_cast<const char*>( mAddr ), mSize ); }
+			size_t size() const { return mSize; }
+
+			static Result<std::shared_ptr<const MappedFile>> open( const std::string& path ) {
+				Result<std::shared_ptr<const MappedFile>> res;
+				int fd = ::open( path.c_str(), O_RDONLY | O_CLOEXEC );
+				if ( fd < 0 ) {
+					res.setMsg( "cannot open " + path + ": " + std::strerror( errno ) );
+					return res;
+				}
+				struct stat st{};
+				if ( fstat( fd, &st ) != 0 ) {
+					res.setMsg( "cannot stat " + path + ": " + std::strerror( errno ) );
+					::close( fd );
+					return res;
+				}
+				void* addr = nullptr;
+				size_t size = static_cast<size_t>( st.st_size );
+				if ( size ) { // zero-length mappings are not allowed, an empty file maps to nothing
+					addr = mmap( nullptr, size, PROT_READ, MAP_SHARED, fd, 0 );
+					if ( addr == MAP_FAILED ) {
+						res.setMsg( "cannot map " + path + ": " + std::strerror( errno ) );
+						::close( fd );
+						return res;
+					}
+				}
+				::close( fd ); // the mapping keeps its own reference to the file
+				res = std::shared_ptr<const MappedFile>( new MappedFile( addr, size ) );
+				return res;
+			}
+
+			// the whole file as a buffer which keeps the mapping alive
+			static Result<SharedBuffer> buffer( const std::string& path ) {
+				Result<SharedBuffer> res;
+				Result<std::shared_ptr<const MappedFile>> file = open( path );
+				if ( file.invalid() ) {
+					res.setMsg( file.msg() );
+					return res;
+				}
+				std::shared_ptr<const MappedFile> mapping = std::move( file ).get();
+				std::string_view view = mapping->view();
+				res = SharedBuffer( std::move( mapping ), view );
+				return res;
+			}
+
+		private:
+			MappedFile( void* addr, size_t size ) : mAddr(addr), mSize(size) {}
+
+			void* mAddr{nullptr};
+			size_t mSize{0};
+	};
+
+} // namespace Util
+} // namespace NPP
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <optional>
+#include <string>
+#include <utility>
 
 // shamelessly "borrowed" from:
 // https://www.cppstories.com/2021/sphero-cpp-return/
@@ -15,6 +17,9 @@ namespace Util {
 			constexpr Result(T const& t) noexcept
 				: mOptional { t } {}
 
+			constexpr Result(T&& t) noexcept
+				: mOptional { std::move(t) } {}
+
 			explicit constexpr Result( ) noexcept = default;
 
 			[[nodiscard]] constexpr bool valid( ) const noexcept {
@@ -25,10 +30,15 @@ namespace Util {
 				return !valid( );
 			}
 
-			[[nodiscard]] constexpr auto get( ) const -> T {
+			[[nodiscard]] constexpr auto get( ) const & -> T {
 				return mOptional.value( );
 			}
 
+			// moves the value out of an expiring result, i.e. std::move( res ).get()
+			[[nodiscard]] constexpr auto get( ) && -> T {
+				return std::move( mOptional.value( ) );
+			}
+
 			[[nodiscard]] constexpr auto get_or( ) const noexcept -> T {
 				return mOptional.value_or(T( ));
 			}
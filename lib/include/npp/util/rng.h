@@ -2,6 +2,7 @@
 
 #include <ctime>
 #include <memory>
+#include <random>
 
 #include <xoshiro-cpp/xoshiro-cpp.h>
 
@@ -16,7 +17,7 @@ namespace Util {
 
 	class Rng {
 		public:
-			Rng() : mRng( std::make_shared<XoshiroCpp::Xoshiro256StarStar>( std::time(nullptr) ) ) {}
+			Rng() : mRng( std::make_shared<XoshiroCpp::Xoshiro256StarStar>( static_cast<uint64_t>( std::time(nullptr) ) ^ std::random_device{}() ) ) {}
 			~Rng() = default;
 
 			// double between 0..1
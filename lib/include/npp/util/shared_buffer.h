@@ -0,0 +1,45 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+namespace NPP {
+namespace Util {
+
+	// immutable bytes with shared ownership: copies of a SharedBuffer share one allocation, which goes away
+	// with the last of them; the owner is a string moved in, or any object that keeps the viewed bytes alive
+	class SharedBuffer {
+		public:
+			SharedBuffer() = default;
+
+			explicit SharedBuffer( std::string&& data ) {
+				auto str = std::make_shared<const std::string>( std::move(data) );
+				mView = *str;
+				mString = str.get();
+				mOwner = std::move(str);
+			}
+
+			// bytes owned by something else, i.e. a memory mapping
+			SharedBuffer( std::shared_ptr<const void> owner, std::string_view view ) : mOwner( std::move(owner) ), mView(view) {}
+
+			std::string_view view() const { return mView; }
+			const char* data() const { return mView.data(); }
+			size_t size() const { return mView.size(); }
+			bool empty() const { return mView.empty(); }
+
+			// the owning string, nullptr unless the buffer was made from one
+			const std::string* string() const { return mString; }
+
+			// bytes are owned by something other than a string, i.e. they live in a file mapping
+			bool mapped() const { return mOwner && !mString; }
+
+		private:
+			std::shared_ptr<const void> mOwner{};
+			std::string_view mView{};
+			const std::string* mString{nullptr};
+	};
+
+} // namespace Util
+} // namespace NPP
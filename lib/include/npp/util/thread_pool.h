@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace NPP {
+namespace Util {
+
+	// fixed number of workers sharing a FIFO task queue, pending tasks are drained before destruction
+	class ThreadPool {
+		public:
+			explicit ThreadPool( size_t threads ) {
+				for ( size_t i = 0; i < threads; ++i ) {
+					mWorkers.emplace_back( [this]() { work(); } );
+				}
+			}
+
+			~ThreadPool() {
+				{
+					std::lock_guard<std::mutex> lock(mMutex);
+					mStopping = true;
+				}
+				mCondition.notify_all();
+				for ( auto& worker : mWorkers ) {
+					worker.join();
+				}
+			}
+
+			ThreadPool( const ThreadPool& ) = delete;
+			ThreadPool& operator=( const ThreadPool& ) = delete;
+
+			size_t size() const { return mWorkers.size(); }
+
+			template<class F>
+				std::future<std::invoke_result_t<F>> submit( F&& f ) {
+					// packaged_task is move-only, std::function needs a copyable callable
+					auto task = std::make_shared<std::packaged_task<std::invoke_result_t<F>()>>( std::forward<F>(f) );
+					std::future<std::invoke_result_t<F>> res = task->get_future();
+					if ( mWorkers.empty() ) {
+						(*task)(); // no workers, run on the calling thread
+						return res;
+					}
+					{
+						std::lock_guard<std::mutex> lock(mMutex);
+						mTasks.emplace_back( [task]() { (*task)(); } );
+					}
+					mCondition.notify_one();
+					return res;
+				}
+
+		private:
+			void work() {
+				while ( true ) {
+					std::function<void()> task;
+					{
+						std::unique_lock<std::mutex> lock(mMutex);
+						mCondition.wait( lock, [this]() { return mStopping || !mTasks.empty(); } );
+						if ( mTasks.empty() ) { return; } // stopping and drained
+						task = std::move( mTasks.front() );
+						mTasks.pop_front();
+					}
+					task();
+				}
+			}
+
+			std::vector<std::thread> mWorkers{};
+			std::deque<std::function<void()>> mTasks{};
+			std::mutex mMutex{};
+			std::condition_variable mCondition{};
+			bool mStopping{false};
+	};
+
+} // namespace Util
+} // namespace NPP
@@ -381,6 +381,18 @@ namespace Util {
 		return res;
 	}
 
+	// [first, last) of the elements of a sorted map or set whose keys start with prefix, two lookups instead of a scan
+	template< typename SortedT >
+	auto container_prefix_range( SortedT& items, const std::string& prefix ) {
+		auto first = items.lower_bound( prefix );
+		// the smallest key above every key with this prefix: prefix with its last byte incremented
+		std::string next = prefix;
+		while ( next.size() && static_cast<unsigned char>( next.back() ) == 0xFF ) { next.pop_back(); }
+		if ( !next.size() ) { return std::make_pair( first, items.end() ); }
+		next.back() = static_cast<char>( static_cast<unsigned char>( next.back() ) + 1 );
+		return std::make_pair( first, items.lower_bound( next ) );
+	}
+
 	template< typename ContainerT, typename PredicateT >
   void container_erase_if( ContainerT& items, const PredicateT& predicate ) {
     for( auto it = items.begin(); it != items.end(); ) {
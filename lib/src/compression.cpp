@@ -0,0 +1,174 @@
+#include "npp/util/compression.h"
+
+#include <utility>
+
+#if defined(CDBNPP_WITH_ZSTD)
+#include <zstd.h>
+#endif
+
+#if defined(CDBNPP_WITH_LZ4)
+#include <lz4frame.h>
+#endif
+
+namespace NPP {
+namespace Util {
+
+	bool codec_known( const std::string& codec ) {
+		return codec == "zstd" || codec == "lz4";
+	}
+
+	bool codec_available( const std::string& codec ) {
+#if defined(CDBNPP_WITH_ZSTD)
+		if ( codec == "zstd" ) { return true; }
+#endif
+#if defined(CDBNPP_WITH_LZ4)
+		if ( codec == "lz4" ) { return true; }
+#endif
+		(void)codec;
+		return false;
+	}
+
+	std::vector<std::string> codecs_available() {
+		std::vector<std::string> res;
+		for ( const auto& codec : { "zstd", "lz4" } ) {
+			if ( codec_available( codec ) ) { res.push_back( codec ); }
+		}
+		return res;
+	}
+
+	std::string codec_file_extension( const std::string& codec ) {
+		return codec == "zstd" ? "zst" : codec;
+	}
+
+	std::string codec_from_file_extension( const std::string& extension ) {
+		if ( extension == "zst" ) { return "zstd"; }
+		if ( extension == "lz4" ) { return "lz4"; }
+		return "";
+	}
+
+	Result<std::string> compress( std::string_view data, const std::string& codec, int level ) {
+		Result<std::string> res;
+#if defined(CDBNPP_WITH_ZSTD)
+		if ( codec == "zstd" ) {
+			std::string out( ZSTD_compressBound( data.size() ), '\0' );
+			size_t rc = ZSTD_compress( &out[0], out.size(), data.data(), data.size(), level ? level : ZSTD_CLEVEL_DEFAULT );
+			if ( ZSTD_isError( rc ) ) {
+				res.setMsg( std::string("zstd compression failed: ") + ZSTD_getErrorName( rc ) );
+				return res;
+			}
+			out.resize( rc );
+			res = std::move(out);
+			return res;
+		}
+#endif
+#if defined(CDBNPP_WITH_LZ4)
+		if ( codec == "lz4" ) {
+			LZ4F_preferences_t prefs{};
+			prefs.frameInfo.contentSize = data.size(); // lets the reader allocate once
+			prefs.compressionLevel = level;
+			std::string out( LZ4F_compressFrameBound( data.size(), &prefs ), '\0' );
+			size_t rc = LZ4F_compressFrame( &out[0], out.size(), data.data(), data.size(), &prefs );
+			if ( LZ4F_isError( rc ) ) {
+				res.setMsg( std::string("lz4 compression failed: ") + LZ4F_getErrorName( rc ) );
+				return res;
+			}
+			out.resize( rc );
+			res = std::move(out);
+			return res;
+		}
+#endif
+		(void)data; (void)level;
+		res.setMsg( "codec is not available in this build: " + codec );
+		return res;
+	}
+
+	Result<std::string> decompress( std::string_view data, const std::string& codec ) {
+		Result<std::string> res;
+#if defined(CDBNPP_WITH_ZSTD)
+		if ( codec == "zstd" ) {
+			std::string out;
+			unsigned long long size = ZSTD_getFrameContentSize( data.data(), data.size() );
+			if ( size == ZSTD_CONTENTSIZE_ERROR ) {
+				res.setMsg( "not a zstd frame" );
+				return res;
+			}
+			if ( size != ZSTD_CONTENTSIZE_UNKNOWN ) {
+				out.resize( size );
+				size_t rc = ZSTD_decompress( &out[0], out.size(), data.data(), data.size() );
+				if ( ZSTD_isError( rc ) || rc != size ) {
+					res.setMsg( std::string("zstd decompression failed: ") + ( ZSTD_isError( rc ) ? ZSTD_getErrorName( rc ) : "size mismatch" ) );
+					return res;
+				}
+				res = std::move(out);
+				return res;
+			}
+
+			// written by a streaming compressor, size not recorded
+			ZSTD_DStream* ds = ZSTD_createDStream();
+			std::string chunk( ZSTD_DStreamOutSize(), '\0' );
+			ZSTD_inBuffer in{ data.data(), data.size(), 0 };
+			size_t rc = 0;
+			bool flushed = true;
+			// once all input is in, the decoder may still hold output back: go on while it filled the last chunk
+			while ( in.pos < in.size || ( rc != 0 && !flushed ) ) {
+				ZSTD_outBuffer ob{ &chunk[0], chunk.size(), 0 };
+				rc = ZSTD_decompressStream( ds, &ob, &in );
+				if ( ZSTD_isError( rc ) ) { break; }
+				out.append( chunk.data(), ob.pos );
+				flushed = ob.pos < ob.size;
+			}
+			ZSTD_freeDStream( ds );
+			if ( ZSTD_isError( rc ) || rc != 0 ) {
+				res.setMsg( std::string("zstd decompression failed: ") + ( ZSTD_isError( rc ) ? ZSTD_getErrorName( rc ) : "truncated frame" ) );
+				return res;
+			}
+			res = std::move(out);
+			return res;
+		}
+#endif
+#if defined(CDBNPP_WITH_LZ4)
+		if ( codec == "lz4" ) {
+			LZ4F_dctx* dctx = nullptr;
+			if ( LZ4F_isError( LZ4F_createDecompressionContext( &dctx, LZ4F_VERSION ) ) ) {
+				res.setMsg( "cannot create lz4 decompression context" );
+				return res;
+			}
+			std::string out;
+			const char* src = data.data();
+			size_t remaining = data.size();
+
+			LZ4F_frameInfo_t info{};
+			size_t consumed = remaining;
+			size_t rc = LZ4F_getFrameInfo( dctx, &info, src, &consumed );
+			if ( !LZ4F_isError( rc ) ) {
+				src += consumed;
+				remaining -= consumed;
+				if ( info.contentSize ) { out.reserve( info.contentSize ); }
+				std::string chunk( 64 * 1024, '\0' );
+				// rc is the hint for the next input size, 0 once the frame is complete
+				while ( rc != 0 ) {
+					size_t out_size = chunk.size(), in_size = remaining;
+					rc = LZ4F_decompress( dctx, &chunk[0], &out_size, src, &in_size, nullptr );
+					if ( LZ4F_isError( rc ) ) { break; }
+					out.append( chunk.data(), out_size );
+					src += in_size;
+					remaining -= in_size;
+					if ( !out_size && !in_size ) { break; } // truncated frame
+				}
+			}
+			LZ4F_freeDecompressionContext( dctx );
+			if ( LZ4F_isError( rc ) || rc != 0 ) {
+				res.setMsg( std::string("lz4 decompression failed: ") + ( LZ4F_isError( rc ) ? LZ4F_getErrorName( rc ) : "truncated frame" ) );
+				return res;
+			}
+			res = std::move(out);
+			return res;
+		}
+#endif
+		(void)data;
+		res.setMsg( "codec is not available in this build: " + codec );
+		return res;
+	}
+
+} // namespace Util
+} // namespace NPP
@@ -1,36 +1,169 @@
 
 #include "npp/cdb/http_client.h"
 
+#include <unordered_map>
+
+#include "npp/util/log.h"
+
 namespace NPP {
 namespace CDB {
 
+	using namespace NPP::Util;
+
 	HttpClient::HttpClient() {}
 	HttpClient::~HttpClient() {}
 
-	HttpResponse HttpClient::Get( const std::string& url ) {
-		std::shared_ptr<HttpCurlHolder> curl = PrepareGet( url );
+	HttpResponse HttpClient::Get( const std::string& url, const std::string& token ) {
+		HttpResponse cached;
+		if ( mResponseCache.lookup( url, cached ) ) {
+			return cached;
+		}
+		std::shared_ptr<HttpCurlHolder> curl = PrepareGet( url, token );
 		CURLcode rc = curl->Perform();
-		return HttpResponse( curl, std::move(curl->mResponseString), std::move(curl->mHeaderString), rc );
+		HttpResponse r = mResponseCache.update( url, HttpResponse( curl, std::move(curl->mResponseString), std::move(curl->mHeaderString), rc ) );
+		if ( r.status_code == 304 ) {
+			// stored copy was evicted meanwhile, ask for the full reply
+			curl = PrepareGet( url, token, false );
+			rc = curl->Perform();
+			r = mResponseCache.update( url, HttpResponse( curl, std::move(curl->mResponseString), std::move(curl->mHeaderString), rc ) );
+		}
+		return r;
 	}
 
-	std::shared_ptr<HttpCurlHolder> HttpClient::PrepareGet( const std::string& url ) {
-		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>();
-		SetCommon( curl );
+	std::shared_ptr<HttpCurlHolder> HttpClient::PrepareGet( const std::string& url, const std::string& token, bool conditional ) {
+		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>( mHandlePool );
+		SetCommon( curl, token );
 		curl->SetUrl( url );
 		curl->SetGET();
+		if ( conditional ) {
+			std::string etag = mResponseCache.etag( url );
+			if ( etag.size() ) {
+				curl->AppendHeader( "If-None-Match: " + etag );
+			}
+		}
 		curl->FinalizeHeaders();
 		return curl;
 	}
 
-	HttpResponse HttpClient::Post( const std::string& url, const HttpPostParams_t& params, const std::string& filename, const std::string& filedata ) {
-		std::shared_ptr<HttpCurlHolder> curl = PreparePost( url, params, filename, filedata );
+	std::vector<HttpResponse> HttpClient::GetMany( const std::vector<std::string>& urls, const std::string& token ) {
+		return GetMany( urls, [&token]( const std::string& ) { return token; } );
+	}
+
+	std::vector<HttpResponse> HttpClient::GetMany( const std::vector<std::string>& urls, const HttpTokenSource_t& token ) {
+		std::vector<HttpResponse> res( urls.size() );
+
+		// fresh cached replies need no transfer at all
+		std::vector<bool> done( urls.size(), false );
+		for ( size_t i = 0; i < urls.size(); ++i ) {
+			done[i] = mResponseCache.lookup( urls[i], res[i] );
+		}
+
+		CURLM* multi = curl_multi_init();
+		if ( !multi ) {
+			CDBNPP_LOG_ERROR << "cannot create curl multi handle, requests will be serialized" << std::endl;
+			for ( size_t i = 0; i < urls.size(); ++i ) {
+				if ( !done[i] ) {
+					res[i] = Get( urls[i], token( urls[i] ) );
+				}
+			}
+			return res;
+		}
+		curl_multi_setopt( multi, CURLMOPT_MAX_TOTAL_CONNECTIONS, static_cast<long>( mMaxConcurrentRequests ) );
+		curl_multi_setopt( multi, CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX );
+
+		std::vector<HttpCurlHolderPtr_t> curls( urls.size() );
+		std::vector<CURLcode> codes( urls.size(), CURLE_OK );
+		std::unordered_map<CURL*, size_t> attached; // handle => url index, while on the multi handle
+		size_t next = 0, in_flight = 0;
+
+		// keep at most mMaxConcurrentRequests transfers on the multi handle, refill as they finish
+		auto add_transfers = [&]() {
+			while ( next < urls.size() && in_flight < mMaxConcurrentRequests ) {
+				if ( done[next] ) {
+					++next;
+					continue;
+				}
+				curls[next] = PrepareGet( urls[next], token( urls[next] ) );
+				attached.insert({ curls[next]->getHandle(), next });
+				curl_multi_add_handle( multi, curls[next]->getHandle() );
+				++next;
+				++in_flight;
+			}
+		};
+
+		add_transfers();
+		while ( in_flight > 0 ) {
+			int running = 0;
+			if ( curl_multi_perform( multi, &running ) != CURLM_OK ) { break; }
+			int queued = 0;
+			while ( CURLMsg* msg = curl_multi_info_read( multi, &queued ) ) {
+				if ( msg->msg != CURLMSG_DONE ) { continue; }
+				codes[ attached[ msg->easy_handle ] ] = msg->data.result;
+				curl_multi_remove_handle( multi, msg->easy_handle );
+				attached.erase( msg->easy_handle );
+				--in_flight;
+			}
+			add_transfers();
+			if ( in_flight > 0 ) {
+#if LIBCURL_VERSION_NUM >= 0x074200
+				curl_multi_poll( multi, nullptr, 0, 1000, nullptr );
+#else
+				curl_multi_wait( multi, nullptr, 0, 1000, nullptr );
+#endif
+			}
+		}
+
+		// transfers left over after a multi error are detached and redone the blocking way below
+		for ( const auto& [ handle, i ] : attached ) {
+			curl_multi_remove_handle( multi, handle );
+			codes[i] = CURLE_FAILED_INIT;
+		}
+		curl_multi_cleanup( multi );
+
+		// once a blocking retry runs out of attempts, the server is treated as down for the rest of the batch,
+		// so a dead server costs one retry deadline instead of one per transfer
+		bool server_down = false;
+		for ( size_t i = 0; i < urls.size(); ++i ) {
+			if ( done[i] ) { continue; }
+			long http_code = 0;
+			if ( !curls[i] ) {
+				curls[i] = PrepareGet( urls[i], token( urls[i] ) );
+				codes[i] = server_down ? CURLE_COULDNT_CONNECT : curls[i]->Perform();
+			} else if ( codes[i] != CURLE_OK && !server_down ) {
+				// transient failures get the same retry policy as single requests, on a freshly signed request
+				curl_easy_getinfo( curls[i]->getHandle(), CURLINFO_RESPONSE_CODE, &http_code );
+				if ( HttpRetryPolicy::isRetryable( codes[i], http_code ) ) {
+					curls[i] = PrepareGet( urls[i], token( urls[i] ) );
+					codes[i] = curls[i]->Perform();
+				}
+			}
+			if ( codes[i] != CURLE_OK && !server_down ) {
+				curl_easy_getinfo( curls[i]->getHandle(), CURLINFO_RESPONSE_CODE, &http_code );
+				server_down = HttpRetryPolicy::isRetryable( codes[i], http_code );
+			}
+			res[i] = mResponseCache.update( urls[i], HttpResponse( curls[i], std::move(curls[i]->mResponseString), std::move(curls[i]->mHeaderString), codes[i] ) );
+			if ( res[i].status_code == 304 ) {
+				// stored copy was evicted meanwhile, ask for the full reply
+				curls[i] = PrepareGet( urls[i], token( urls[i] ), false );
+				codes[i] = curls[i]->Perform();
+				res[i] = mResponseCache.update( urls[i], HttpResponse( curls[i], std::move(curls[i]->mResponseString), std::move(curls[i]->mHeaderString), codes[i] ) );
+			}
+		}
+
+		return res;
+	}
+
+	HttpResponse HttpClient::Post( const std::string& url, const HttpPostParams_t& params, const std::string& filename, const std::string& filedata,
+			const std::string& token ) {
+		std::shared_ptr<HttpCurlHolder> curl = PreparePost( url, params, filename, filedata, token );
 		CURLcode rc = curl->Perform();
 		return HttpResponse( curl, std::move(curl->mResponseString), std::move(curl->mHeaderString), rc );
 	}
 
-	std::shared_ptr<HttpCurlHolder> HttpClient::PreparePost( const std::string& url, const HttpPostParams_t& params, const std::string& filename, const std::string& filedata ) {
-		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>();
-		SetCommon( curl );
+	std::shared_ptr<HttpCurlHolder> HttpClient::PreparePost( const std::string& url, const HttpPostParams_t& params, const std::string& filename, const std::string& filedata,
+			const std::string& token ) {
+		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>( mHandlePool );
+		SetCommon( curl, token );
 		curl->SetUrl( url );
 		curl->SetPOST();
 		curl->SetPostParams( params, filename, filedata );
@@ -45,7 +178,7 @@ namespace CDB {
 	}
 
 	std::shared_ptr<HttpCurlHolder> HttpClient::PreparePost( const std::string& url, const std::string& body, const std::string& header ) {
-		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>();
+		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>( mHandlePool );
 		SetCommon( curl );
 		curl->SetUrl( url );
 		curl->SetPOST();
@@ -64,7 +197,7 @@ namespace CDB {
 	}
 
 	std::shared_ptr<HttpCurlHolder> HttpClient::PreparePatch( const std::string& url, const std::string& body, const std::string& header ) {
-		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>();
+		std::shared_ptr<HttpCurlHolder> curl = std::make_shared<HttpCurlHolder>( mHandlePool );
 		SetCommon( curl );
 		curl->SetUrl( url );
 		curl->SetPATCH();
@@ -76,17 +209,20 @@ namespace CDB {
 		return curl;
 	}
 
-	void HttpClient::SetCommon( std::shared_ptr<HttpCurlHolder>& curl ) {
+	void HttpClient::SetCommon( std::shared_ptr<HttpCurlHolder>& curl, const std::string& token ) {
 		curl->SetVerbose( mVerbose );
 		curl->SetTimeout( mTimeoutMs );
 		curl->SetConnectTimeout( mConnectTimeoutMs );
 		curl->SetUserAgent( mUserAgent );
 		curl->SetVerifySsl( mVerifySsl );
-		if ( mToken.size() ) {
-			curl->AppendHeader( "Authorization: Bearer " + mToken );
+		if ( mHttp2 ) {
+			curl->SetHttp2( true );
+		}
+		const std::string& bearer = token.size() ? token : mToken;
+		if ( bearer.size() ) {
+			curl->AppendHeader( "Authorization: Bearer " + bearer );
 		}
-		curl->SetMaxRetries( mMaxRetries );
-		curl->SetSleepSeconds( mSleepSeconds );
+		curl->SetRetryPolicy( mRetryPolicy );
 	}
 
 } // namespace CDB
@@ -1,23 +1,134 @@
 
 #include "npp/cdb/http_curl_holder.h"
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 #include <thread>
 
 #include "npp/util/log.h"
+#include "npp/util/rng.h"
 
 namespace NPP {
 namespace CDB {
 
 	using namespace NPP::Util;
 
+	long HttpRetryPolicy::backoffMs( unsigned int attempt ) const {
+		thread_local Rng rng;
+		long cap = initialBackoffMs;
+		for ( unsigned int i = 0; i < attempt && cap < maxBackoffMs; ++i ) {
+			cap *= 2;
+		}
+		cap = std::max( 0L, std::min( cap, maxBackoffMs ) );
+		// full jitter spreads the retries of many clients hit by the same outage
+		return cap ? std::min( rng.random_inclusive<long>( 0, cap ), cap ) : 0;
+	}
+
+	long HttpRetryPolicy::windowMs( long timeoutMs ) const {
+		long window = static_cast<long>( maxRetries + 1 ) * timeoutMs + static_cast<long>( maxRetries ) * maxBackoffMs;
+		// no retry starts past the deadline, but the one in flight then still runs to its timeout
+		return deadlineMs > 0 ? std::min( window, deadlineMs + timeoutMs ) : window;
+	}
+
+	bool HttpRetryPolicy::isRetryable( CURLcode rc, long http_code ) {
+		if ( http_code == 429 || http_code >= 500 ) { return true; }
+		switch ( rc ) {
+			case CURLE_COULDNT_RESOLVE_HOST:
+			case CURLE_COULDNT_CONNECT:
+			case CURLE_OPERATION_TIMEDOUT:
+			case CURLE_SEND_ERROR:
+			case CURLE_RECV_ERROR:
+			case CURLE_GOT_NOTHING:
+			case CURLE_PARTIAL_FILE:
+			case CURLE_FAILED_INIT:
+				return true;
+			default:
+				return false;
+		}
+	}
+
 	size_t cdbWriteFunction(char* ptr, size_t size, size_t nmemb, std::string* data) {
 		size *= nmemb;
 		data->append(ptr, size);
 		return size;
 	}
 
+	HttpCurlHandlePool::HttpCurlHandlePool( size_t max_idle ) : mMaxIdle(max_idle) {
+		mShare = curl_share_init();
+		if ( !mShare ) {
+			CDBNPP_LOG_ERROR << "cannot create curl share handle, DNS and TLS sessions will not be shared" << std::endl;
+			return;
+		}
+		curl_share_setopt( mShare, CURLSHOPT_LOCKFUNC, lockShare );
+		curl_share_setopt( mShare, CURLSHOPT_UNLOCKFUNC, unlockShare );
+		curl_share_setopt( mShare, CURLSHOPT_USERDATA, this );
+		curl_share_setopt( mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS );
+		curl_share_setopt( mShare, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION );
+		// NOTE: CURL_LOCK_DATA_CONNECT is not safe with concurrent threads, connections are reused per handle instead
+	}
+
+	HttpCurlHandlePool::~HttpCurlHandlePool() {
+		// handles have to go before the share they use
+		for ( CURL* handle : mIdle ) {
+			curl_easy_cleanup( handle );
+		}
+		mIdle.clear();
+		if ( mShare ) {
+			curl_share_cleanup( mShare );
+		}
+	}
+
+	CURL* HttpCurlHandlePool::acquire() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		if ( mIdle.empty() ) { return nullptr; }
+		CURL* handle = mIdle.back();
+		mIdle.pop_back();
+		return handle;
+	}
+
+	void HttpCurlHandlePool::release( CURL* handle ) {
+		if ( !handle ) { return; }
+		// reset keeps live connections, DNS cache and TLS session ids, but drops per-request options
+		curl_easy_reset( handle );
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			if ( mIdle.size() < mMaxIdle ) {
+				mIdle.push_back( handle );
+				return;
+			}
+		}
+		curl_easy_cleanup( handle );
+	}
+
+	void HttpCurlHandlePool::setMaxIdle( size_t max_idle ) {
+		std::vector<CURL*> excess;
+		{
+			std::lock_guard<std::mutex> lock(mMutex);
+			mMaxIdle = max_idle;
+			while ( mIdle.size() > mMaxIdle ) {
+				excess.push_back( mIdle.back() );
+				mIdle.pop_back();
+			}
+		}
+		for ( CURL* handle : excess ) {
+			curl_easy_cleanup( handle );
+		}
+	}
+
+	size_t HttpCurlHandlePool::idle() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mIdle.size();
+	}
+
+	void HttpCurlHandlePool::lockShare( __attribute__((unused)) CURL* handle, curl_lock_data data, __attribute__((unused)) curl_lock_access access, void* userptr ) {
+		static_cast<HttpCurlHandlePool*>( userptr )->mShareMutexes[ data ].lock();
+	}
+
+	void HttpCurlHandlePool::unlockShare( __attribute__((unused)) CURL* handle, curl_lock_data data, void* userptr ) {
+		static_cast<HttpCurlHandlePool*>( userptr )->mShareMutexes[ data ].unlock();
+	}
+
 	std::mutex HttpCurlHolder::curl_easy_init_mutex_{};
 
 	HttpCurlHolder::HttpCurlHolder() {
@@ -32,8 +143,31 @@ namespace CDB {
 		}
 	}
 
+	HttpCurlHolder::HttpCurlHolder( HttpCurlHandlePoolPtr_t pool ) : mPool(std::move(pool)) {
+		handle = mPool ? mPool->acquire() : nullptr;
+		if ( !handle ) {
+			curl_easy_init_mutex_.lock();
+			handle = curl_easy_init();
+			curl_easy_init_mutex_.unlock();
+		}
+		if ( handle ) {
+			SetCommon();
+			if ( mPool && mPool->share() ) {
+				curl_easy_setopt( handle, CURLOPT_SHARE, mPool->share() );
+			}
+		} else {
+			std::cerr << "CDBNPP HttpClient FATAL ERROR: cannot get curl handle" << std::endl;
+			std::exit(EXIT_FAILURE);
+		}
+	}
+
 	HttpCurlHolder::~HttpCurlHolder() {
-		curl_easy_cleanup(handle);
+		// handle is reset before the mime and headers it points to are freed
+		if ( mPool ) {
+			mPool->release(handle);
+		} else {
+			curl_easy_cleanup(handle);
+		}
 		curl_mime_free(mime);
 		curl_slist_free_all(headers);
 	}
@@ -63,6 +197,10 @@ namespace CDB {
 		curl_easy_setopt( handle, CURLOPT_SSL_VERIFYHOST, verify ? 2L : 0L );
 	}
 
+	void HttpCurlHolder::SetHttp2(bool http2) {
+		curl_easy_setopt( handle, CURLOPT_HTTP_VERSION, http2 ? CURL_HTTP_VERSION_2TLS : CURL_HTTP_VERSION_NONE );
+	}
+
 	void HttpCurlHolder::SetCommon() {
 		curl_easy_setopt( handle, CURLOPT_NOPROGRESS, 1L );
 		curl_easy_setopt( handle, CURLOPT_FAILONERROR, true );
@@ -75,6 +213,7 @@ namespace CDB {
 		curl_easy_setopt( handle, CURLOPT_FOLLOWLOCATION, 1L );
 		curl_easy_setopt( handle, CURLOPT_MAXREDIRS, 10L );
 		curl_easy_setopt( handle, CURLOPT_AUTOREFERER, 1L);
+		curl_easy_setopt( handle, CURLOPT_TCP_KEEPALIVE, 1L );
 	}
 
 	void HttpCurlHolder::SetGET() {
@@ -105,7 +244,8 @@ namespace CDB {
 		curl_mimepart *part;
 		for ( const auto& [key, value] : params ) {
 			part = curl_mime_addpart(mime);
-			curl_mime_data( part, value.c_str(), CURL_ZERO_TERMINATED );
+			// explicit length: values may be binary, i.e. compressed payload data with NUL bytes in it
+			curl_mime_data( part, value.data(), value.size() );
 			curl_mime_name( part, key.c_str() );
 		}
 		if ( filename.length() ) {
@@ -137,17 +277,23 @@ namespace CDB {
 	CURLcode HttpCurlHolder::Perform() {
 		CURLcode rc = CURLE_OK;
 		long http_code;
-		for ( unsigned int i = 0; i < ( mMaxRetries + 1 ); ++i ) {
+		auto start = std::chrono::steady_clock::now();
+		for ( unsigned int attempt = 0; ; ++attempt ) {
 			rc = curl_easy_perform( handle );
 			http_code = 0;
 			curl_easy_getinfo ( handle, CURLINFO_RESPONSE_CODE, &http_code );
 			if ( rc == CURLE_OK ) { break; }
-			if ( http_code < 500 ) {
-				// successful request, missing endpoint, unauthorized access errors => cannot retry
+			if ( !HttpRetryPolicy::isRetryable( rc, http_code ) ) {
+				// missing endpoint, unauthorized access, bad request => cannot retry
 				break;
 			}
-			// retry http error 500..599 codes => sleep for N seconds, rinse and repeat
-			std::this_thread::sleep_for( std::chrono::milliseconds( (int)( mSleepSeconds * 1e3 ) ) );
+			if ( attempt >= mRetryPolicy.maxRetries ) { break; }
+			long backoff = mRetryPolicy.backoffMs( attempt );
+			if ( mRetryPolicy.deadlineMs > 0 ) {
+				long elapsed = std::chrono::duration_cast<std::chrono::milliseconds>( std::chrono::steady_clock::now() - start ).count();
+				if ( elapsed + backoff >= mRetryPolicy.deadlineMs ) { break; } // give the caller a chance to fail over instead
+			}
+			std::this_thread::sleep_for( std::chrono::milliseconds( backoff ) );
 			mResponseString = "";
 			mHeaderString = "";
 		}
@@ -0,0 +1,127 @@
+#include "npp/cdb/http_disk_cache.h"
+
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <system_error>
+#include <tuple>
+#include <vector>
+
+#include <unistd.h>
+
+#include <picosha2/picosha2.h>
+
+#include "npp/util/log.h"
+
+namespace NPP {
+namespace CDB {
+
+	using namespace NPP::Util;
+
+	namespace fs = std::filesystem;
+
+	HttpDiskCache::HttpDiskCache( const std::string& dir, uint64_t max_bytes ) : mDir(dir), mMaxBytes(max_bytes) {
+		std::error_code ec;
+		fs::create_directories( mDir, ec );
+		if ( ec ) {
+			CDBNPP_LOG_ERROR << "cannot create disk cache directory " << mDir << ": " << ec.message() << std::endl;
+		}
+	}
+
+	std::string HttpDiskCache::key( const std::string& id, const std::string& uri ) {
+		return picosha2::hash256_hex_string( id + "\n" + uri );
+	}
+
+	bool HttpDiskCache::get( const std::string& key, std::string& data ) {
+		std::string path = entryPath( key );
+		std::ifstream in( path, std::ios::binary );
+		if ( !in.is_open() ) { return false; }
+		std::string content{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+		if ( in.bad() ) { return false; }
+		data = std::move(content);
+
+		// touch, so the entry counts as recently used
+		std::error_code ec;
+		fs::last_write_time( path, fs::file_time_type::clock::now(), ec );
+		return true;
+	}
+
+	bool HttpDiskCache::put( const std::string& key, const std::string& data ) {
+		if ( data.size() > mMaxBytes ) { return false; }
+
+		std::string path = entryPath( key );
+		std::error_code ec;
+		fs::create_directories( fs::path( path ).parent_path(), ec );
+
+		// readers never see partial files: write aside, then rename over the entry in one step
+		std::string tmp_path = path + ".tmp." + std::to_string( ::getpid() ) + "." + std::to_string( mTmpCounter++ );
+		{
+			std::ofstream out( tmp_path, std::ios::binary | std::ios::trunc );
+			if ( !out.is_open() ) { return false; }
+			out.write( data.data(), static_cast<std::streamsize>( data.size() ) );
+			out.close();
+			if ( out.fail() ) {
+				fs::remove( tmp_path, ec );
+				return false;
+			}
+		}
+		fs::rename( tmp_path, path, ec );
+		if ( ec ) {
+			fs::remove( tmp_path, ec );
+			return false;
+		}
+
+		// amortize the directory scan over a tenth of the limit written
+		if ( ( mWrittenSinceCleanup += data.size() ) > mMaxBytes / 10 ) {
+			mWrittenSinceCleanup = 0;
+			cleanup();
+		}
+		return true;
+	}
+
+	void HttpDiskCache::cleanup() {
+		std::unique_lock<std::mutex> lock( mCleanupMutex, std::try_to_lock );
+		if ( !lock.owns_lock() ) { return; } // somebody is on it already
+
+		std::vector<std::tuple<fs::file_time_type, uint64_t, fs::path>> entries;
+		uint64_t total = 0;
+		auto now = fs::file_time_type::clock::now();
+		std::error_code ec;
+		for ( auto it = fs::recursive_directory_iterator( mDir, ec ); !ec && it != fs::recursive_directory_iterator(); it.increment( ec ) ) {
+			if ( !it->is_regular_file( ec ) ) { continue; }
+			uint64_t size = it->file_size( ec );
+			if ( ec ) { continue; }
+			fs::file_time_type mtime = it->last_write_time( ec );
+			if ( ec ) { continue; }
+			if ( it->path().filename().string().find( ".tmp." ) != std::string::npos ) {
+				// writer died before the rename
+				if ( now - mtime > std::chrono::hours(1) ) {
+					fs::remove( it->path(), ec );
+				}
+				continue;
+			}
+			entries.emplace_back( mtime, size, it->path() );
+			total += size;
+		}
+		if ( total <= mMaxBytes ) { return; }
+
+		// oldest first, shrink below 90% of the limit so the next few writes do not trigger another scan
+		std::sort( entries.begin(), entries.end() );
+		uint64_t target = mMaxBytes - mMaxBytes / 10;
+		for ( const auto& [ mtime, size, path ] : entries ) {
+			if ( total <= target ) { break; }
+			if ( fs::remove( path, ec ) ) {
+				total -= size;
+			}
+		}
+	}
+
+	std::string HttpDiskCache::entryPath( const std::string& key ) const {
+		// two-level layout keeps directories small
+		return mDir + "/" + key.substr( 0, 2 ) + "/" + key;
+	}
+
+} // namespace CDB
+} // namespace NPP
@@ -0,0 +1,176 @@
+#include "npp/cdb/http_response_cache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <sstream>
+
+namespace NPP {
+namespace CDB {
+
+	bool HttpResponseCache::lookup( const std::string& url, HttpResponse& response ) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find( url );
+		if ( it == mEntries.end() || Clock_t::now() >= it->second.expires ) {
+			return false;
+		}
+		mLru.splice( mLru.begin(), mLru, it->second.lru );
+		response = toResponse( it->second );
+		return true;
+	}
+
+	std::string HttpResponseCache::etag( const std::string& url ) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find( url );
+		return it != mEntries.end() ? it->second.etag : "";
+	}
+
+	HttpResponse HttpResponseCache::update( const std::string& url, HttpResponse&& response ) {
+		if ( response.error || ( response.status_code != 200 && response.status_code != 304 ) ) {
+			return std::move(response);
+		}
+
+		Directives d = parseHeaders( response.header );
+		std::lock_guard<std::mutex> lock(mMutex);
+		auto it = mEntries.find( url );
+
+		if ( response.status_code == 304 ) {
+			if ( it == mEntries.end() ) {
+				// evicted while the request was in flight, nothing to substitute
+				response.error = CURLE_HTTP_RETURNED_ERROR;
+				return std::move(response);
+			}
+			// still valid, the 304 may carry fresh caching directives
+			it->second.expires = Clock_t::now() + std::chrono::seconds( d.maxAge );
+			if ( d.etag.size() ) {
+				it->second.etag = d.etag;
+			}
+			mLru.splice( mLru.begin(), mLru, it->second.lru );
+			HttpResponse cached = toResponse( it->second );
+			cached.elapsed = response.elapsed;
+			cached.downloaded_bytes = response.downloaded_bytes;
+			if ( d.noStore ) {
+				erase( it );
+			}
+			return cached;
+		}
+
+		if ( it != mEntries.end() ) {
+			erase( it );
+		}
+		size_t entry_bytes = url.size() + response.text.size() + response.header.size() + response.url.size();
+		if ( !d.store || entry_bytes > mMaxBytes ) {
+			return std::move(response);
+		}
+
+		mLru.push_front( url );
+		Entry& e = mEntries[ url ];
+		e.status = response.status_code;
+		e.text = response.text;
+		e.header = response.header;
+		e.url = response.url;
+		e.etag = d.etag;
+		e.expires = Clock_t::now() + std::chrono::seconds( d.maxAge );
+		e.lru = mLru.begin();
+		mBytes += entry_bytes;
+		evict();
+		return std::move(response);
+	}
+
+	void HttpResponseCache::setMaxBytes( size_t max_bytes ) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mMaxBytes = max_bytes;
+		evict();
+	}
+
+	size_t HttpResponseCache::bytes() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mBytes;
+	}
+
+	size_t HttpResponseCache::size() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		return mEntries.size();
+	}
+
+	void HttpResponseCache::clear() {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mEntries.clear();
+		mLru.clear();
+		mBytes = 0;
+	}
+
+	void HttpResponseCache::erase( std::unordered_map<std::string, Entry>::iterator it ) {
+		mBytes -= it->first.size() + it->second.text.size() + it->second.header.size() + it->second.url.size();
+		mLru.erase( it->second.lru );
+		mEntries.erase( it );
+	}
+
+	void HttpResponseCache::evict() {
+		while ( mBytes > mMaxBytes && mLru.size() ) {
+			erase( mEntries.find( mLru.back() ) );
+		}
+	}
+
+	HttpResponse HttpResponseCache::toResponse( const Entry& e ) {
+		HttpResponse response;
+		response.status_code = e.status;
+		response.text = e.text;
+		response.header = e.header;
+		response.url = e.url;
+		return response;
+	}
+
+	HttpResponseCache::Directives HttpResponseCache::parseHeaders( const std::string& header ) {
+		Directives d;
+		bool has_cache_control = false, no_cache = false;
+
+		std::istringstream lines( header );
+		std::string line;
+		while ( std::getline( lines, line ) ) {
+			if ( line.size() && line.back() == '\r' ) { line.pop_back(); }
+			if ( line.rfind( "HTTP/", 0 ) == 0 ) {
+				// status line of the next response, earlier headers do not apply
+				d = Directives();
+				has_cache_control = no_cache = false;
+				continue;
+			}
+			size_t colon = line.find( ':' );
+			if ( colon == std::string::npos ) { continue; }
+			std::string name = line.substr( 0, colon );
+			std::transform( name.begin(), name.end(), name.begin(), []( unsigned char c ) { return std::tolower(c); } );
+			std::string value = line.substr( colon + 1 );
+			value.erase( 0, value.find_first_not_of( " \t" ) );
+			value.erase( value.find_last_not_of( " \t" ) + 1 );
+
+			if ( name == "etag" ) {
+				d.etag = value;
+			} else if ( name == "cache-control" ) {
+				has_cache_control = true;
+				std::transform( value.begin(), value.end(), value.begin(), []( unsigned char c ) { return std::tolower(c); } );
+				std::istringstream directives( value );
+				std::string directive;
+				while ( std::getline( directives, directive, ',' ) ) {
+					directive.erase( 0, directive.find_first_not_of( " \t" ) );
+					directive.erase( directive.find_last_not_of( " \t" ) + 1 );
+					if ( directive == "no-store" ) {
+						d.noStore = true;
+					} else if ( directive == "no-cache" ) {
+						no_cache = true;
+					} else if ( directive.rfind( "max-age=", 0 ) == 0 ) {
+						d.maxAge = std::max( 0L, std::strtol( directive.c_str() + 8, nullptr, 10 ) );
+					}
+				}
+			}
+		}
+
+		if ( no_cache ) {
+			d.maxAge = 0; // keep, but revalidate before every use
+		}
+		// without a validator, only an explicit lifetime makes a reply worth keeping
+		d.store = !d.noStore && ( d.etag.size() || ( has_cache_control && d.maxAge > 0 ) );
+		return d;
+	}
+
+} // namespace CDB
+} // namespace NPP
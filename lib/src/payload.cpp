@@ -3,6 +3,7 @@
 
 #include <iostream>
 
+#include "npp/util/compression.h"
 #include "npp/util/log.h"
 #include "npp/util/util.h"
 
@@ -11,47 +12,187 @@ namespace CDB {
 
 	using namespace NPP::Util;
 
+	const std::string& Payload::data() const {
+		static const std::string empty{};
+		if ( !mCodec.size() ) {
+			if ( mData.string() ) { return *mData.string(); }
+			if ( mData.empty() ) { return empty; }
+		}
+
+		std::lock_guard<std::mutex> lock( mDecodedMutex );
+		if ( !mIsDecoded ) {
+			if ( mCodec.size() ) {
+				Result<std::string> rc = decompress( mData.view(), mCodec );
+				if ( rc.valid() ) {
+					mDecoded = SharedBuffer( std::move( rc ).get() );
+				} else {
+					CDBNPP_LOG_ERROR << "cannot decompress payload " << mId << ": " << rc.msg() << std::endl;
+				}
+			} else {
+				mDecoded = SharedBuffer( std::string( mData.view() ) );
+			}
+			mIsDecoded = true;
+		}
+		return mDecoded.string() ? *mDecoded.string() : empty;
+	}
+
+	std::string_view Payload::dataView() const {
+		return mCodec.size() ? std::string_view( data() ) : mData.view();
+	}
+
+	SharedBuffer Payload::dataBuffer() const {
+		if ( !mCodec.size() ) { return mData; }
+		data();
+		std::lock_guard<std::mutex> lock( mDecodedMutex );
+		return mDecoded;
+	}
+
 	nlohmann::json Payload::dataAsJson() const {
+		std::string_view data = dataView();
 		if ( mFmt == "json" ) {
-			return nlohmann::json::parse( mData.begin(), mData.end(), nullptr, false, true );
+			return nlohmann::json::parse( data.begin(), data.end(), nullptr, false, true );
 		} else if ( mFmt == "bson" ) {
-			return nlohmann::json::from_bson( mData.begin(), mData.end(), false, false );
+			return nlohmann::json::from_bson( data.begin(), data.end(), false, false );
 		} else if ( mFmt == "ubjson" ) {
-			return nlohmann::json::from_ubjson( mData.begin(), mData.end(), false, false );
+			return nlohmann::json::from_ubjson( data.begin(), data.end(), false, false );
 		} else if ( mFmt == "cbor" ) {
-			return nlohmann::json::from_cbor( mData.begin(), mData.end(), false, false );
+			return nlohmann::json::from_cbor( data.begin(), data.end(), false, false );
 		} else if ( mFmt == "msgpack" ) {
-			return nlohmann::json::from_msgpack( mData.begin(), mData.end(), false, false );
+			return nlohmann::json::from_msgpack( data.begin(), data.end(), false, false );
 		}
-		return mData;
+		return std::string( data );
 	}
 
 	void Payload::setData( const nlohmann::json& data, const std::string& fmt ) {
+		clearData();
+		std::string bytes;
 		if ( fmt == "bson" ) {
-			nlohmann::json::to_bson( data, mData);
+			nlohmann::json::to_bson( data, bytes );
 			mFmt = fmt;
 		} else if ( fmt == "ubjson" ) {
-			nlohmann::json::to_ubjson( data, mData );
+			nlohmann::json::to_ubjson( data, bytes );
 			mFmt = fmt;
 		} else if ( fmt == "cbor" ) {
-			nlohmann::json::to_cbor( data, mData );
+			nlohmann::json::to_cbor( data, bytes );
 			mFmt = fmt;
 		} else if ( fmt == "msgpack" ) {
-			nlohmann::json::to_msgpack( data, mData );
+			nlohmann::json::to_msgpack( data, bytes );
 			mFmt = fmt;
 		} else {
-			mData = data.dump();
+			bytes = data.dump();
 			mFmt = "json";
 		}
+		mData = SharedBuffer( std::move(bytes) );
+		mHasData.store( mData.size() > 0, std::memory_order_release );
 	}
 
 	void Payload::setData( const std::string& data, const std::string& fmt ) {
-		mData = data;
-		if ( fmt == "json" || fmt == "bson" || fmt == "ubjson" || fmt == "cbor" || fmt == "msgpack" ) {
-			mFmt = fmt;
+		setData( SharedBuffer( std::string( data ) ), fmt );
+	}
+
+	void Payload::setData( std::string_view data, const std::string& fmt ) {
+		setData( SharedBuffer( std::string( data ) ), fmt );
+	}
+
+	void Payload::setData( std::string&& data, const std::string& fmt ) {
+		setData( SharedBuffer( std::move(data) ), fmt );
+	}
+
+	void Payload::setData( SharedBuffer data, const std::string& fmt ) {
+		std::string format = fmt; // fmt may be our own, i.e. storedFormat()
+		clearData();
+		mData = std::move(data);
+		std::string base = format;
+		auto pos = format.find('+');
+		if ( pos != std::string::npos ) {
+			base = format.substr( 0, pos );
+			mCodec = format.substr( pos + 1 );
+			if ( !codec_known( mCodec ) ) {
+				// unknown codec, the data is of no use as anything but opaque bytes
+				mCodec = "";
+				base = "dat";
+			}
+		}
+		if ( base == "json" || base == "bson" || base == "ubjson" || base == "cbor" || base == "msgpack" ) {
+			mFmt = base;
 		} else {
 			mFmt = "dat";
 		}
+		mHasData.store( mData.size() > 0, std::memory_order_release );
+	}
+
+	Result<bool> Payload::fetchDataOnce( const std::function<Result<SharedBuffer>()>& fetch ) {
+		Result<bool> res;
+		if ( hasData() ) {
+			res = false;
+			return res;
+		}
+		std::lock_guard<std::mutex> lock( mFetchMutex );
+		if ( hasData() ) { // filled by the thread we waited for
+			res = false;
+			return res;
+		}
+		Result<SharedBuffer> data = fetch();
+		if ( data.invalid() ) {
+			res.setMsg( data.msg() );
+			return res;
+		}
+		// the adapter that resolved the payload recorded the format it is stored in
+		setData( std::move( data ).get(), storedFormat() );
+		res = true;
+		return res;
+	}
+
+	Result<bool> Payload::compress( const std::string& codec, int level ) {
+		Result<bool> res;
+		if ( mCodec.size() ) {
+			res.setMsg( "payload data is compressed already" );
+			return res;
+		}
+		Result<std::string> rc = NPP::Util::compress( mData.view(), codec, level );
+		if ( rc.invalid() ) {
+			res.setMsg( rc.msg() );
+			return res;
+		}
+		std::string packed = std::move( rc ).get();
+		if ( packed.size() >= mData.size() ) {
+			res = false;
+			return res;
+		}
+		std::lock_guard<std::mutex> lock( mDecodedMutex );
+		mDecoded = mData.string() ? mData : SharedBuffer( std::string( mData.view() ) );
+		mIsDecoded = true;
+		mData = SharedBuffer( std::move(packed) );
+		mCodec = codec;
+		res = true;
+		return res;
+	}
+
+	void Payload::clearData() {
+		mHasData.store( false, std::memory_order_release );
+		std::lock_guard<std::mutex> lock( mDecodedMutex );
+		mData = SharedBuffer();
+		mFmt = "";
+		mCodec = "";
+		mDecoded = SharedBuffer();
+		mIsDecoded = false;
+	}
+
+	std::string Payload::formatFromURI( const std::string& uri ) {
+		auto parts = explode( uri, '.' );
+		if ( parts.size() < 2 ) { return ""; } // no extension
+		std::string fmt = parts.back();
+		sanitize_alnum( fmt );
+		string_to_lower_case( fmt );
+		std::string codec = codec_from_file_extension( fmt );
+		if ( codec.size() ) {
+			// compressed file, the data format is the extension before the codec one
+			fmt = parts.size() > 2 ? parts[ parts.size() - 2 ] : "dat";
+			sanitize_alnum( fmt );
+			string_to_lower_case( fmt );
+			return fmt + "+" + codec;
+		}
+		return fmt;
 	}
 
 	DecodedPathTuple Payload::decodePath( const std::string& path ) {
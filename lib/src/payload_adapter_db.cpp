@@ -1,6 +1,8 @@
 
 #include "npp/cdb/payload_adapter_db.h"
 
+#include <algorithm>
+#include <chrono>
 #include <mutex>
 
 #include "npp/util/base64.h"
@@ -18,8 +20,6 @@ namespace CDB {
 	using namespace soci;
 	using namespace NPP::Util;
 
-	std::mutex cdbnpp_db_access_mutex;  // protects db calls, as SOCI is not thread-safe
-
 	PayloadAdapterDb::PayloadAdapterDb() : IPayloadAdapter("db") {}
 
 	PayloadResults_t PayloadAdapterDb::getPayloads( const std::set<std::string>& paths, const std::vector<std::string>& flavors,
@@ -30,33 +30,376 @@ namespace CDB {
 			return res;
 		}
 
+		// tags and paths stay as they are for the whole lookup, even if a refresh swaps in new ones meanwhile
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+		std::set<std::string> unfolded_paths = unfoldPaths( *snapshot, paths );
+
+		if ( batchSize() > 0 && hasAccess("get") ) {
+			return getPayloadsBatched( *snapshot, unfolded_paths, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
+		}
+
+		for ( const auto& path : unfolded_paths ) {
+			Result<SPayloadPtr_t> rc = getPayload( path, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
+			if ( rc.valid() ) {
+				SPayloadPtr_t p = rc.get();
+				res.insert({ p->directory() + "/" + p->structName(), p });
+			}
+		}
+
+		return res;
+	}
+
+	std::set<std::string> PayloadAdapterDb::unfoldPaths( const TagSnapshot& snapshot, const std::set<std::string>& paths ) {
 		std::set<std::string> unfolded_paths{};
 		for ( const auto& path : paths ) {
 			std::vector<std::string> parts = explode( path, ":" );
 			std::string flavor = parts.size() == 2 ? parts[0] : "";
 			std::string unflavored_path = parts.size() == 2 ? parts[1] : parts[0];
-			if ( mPaths.count(unflavored_path) == 0 ) {
-				for ( const auto& [ key, value ] : mPaths ) {
-					if ( string_starts_with( key, unflavored_path ) && value->mode() > 0 ) {
-						unfolded_paths.insert( ( flavor.size() ? ( flavor + ":" ) : "" ) + key );
-					}
+			auto tagit = snapshot.paths.find( unflavored_path );
+			if ( tagit != snapshot.paths.end() && tagit->second->mode() > 0 ) {
+				unfolded_paths.insert( path );
+				continue;
+			}
+			// directory tag => structs below it, otherwise a plain prefix; paths are sorted, so matches are adjacent
+			std::string prefix = tagit != snapshot.paths.end() ? unflavored_path + "/" : unflavored_path;
+			auto [ first, last ] = container_prefix_range( snapshot.paths, prefix );
+			for ( auto it = first; it != last; ++it ) {
+				if ( it->second->mode() > 0 ) {
+					unfolded_paths.insert( ( flavor.size() ? ( flavor + ":" ) : "" ) + it->first );
 				}
+			}
+		}
+		return unfolded_paths;
+	}
+
+	PayloadList_t PayloadAdapterDb::prefetchPayloads( const std::set<std::string>& paths, const std::vector<std::string>& service_flavors,
+			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t rangeBegin, int64_t rangeEnd, bool byRun ) {
+		PayloadList_t res;
+
+		if ( !ensureMetadata() || !hasAccess("get") ) {
+			return res;
+		}
+
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
+		SessionLease session = leaseSession("get");
+		if ( !session ) {
+			CDBNPP_LOG_ERROR << "cannot lease database session for prefetch" << std::endl;
+			return res;
+		}
+		if ( !byRun && !singleQueryIov( session.dbtype() ) ) {
+			// the time range needs the next beginTime of every row, see singleQueryIov
+			CDBNPP_LOG_ERROR << "prefetch by time is not supported for " << session.dbtype() << " sessions" << std::endl;
+			return res;
+		}
+
+		// one query per struct table, every flavor at once
+		for ( const auto& path : unfoldPaths( *snapshot, paths ) ) {
+			auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
+			const std::vector<std::string>& lookup_flavors = flavors.size() ? flavors : service_flavors;
+			if ( !is_path_valid || !directory.size() || !structName.size() || !lookup_flavors.size() ) { continue; }
+
+			std::string dirpath = directory + "/" + structName;
+			auto tagit = snapshot->paths.find( dirpath );
+			if ( tagit == snapshot->paths.end() || !tagit->second->tbname().size() ) { continue; }
+			// time ranges apply to time-based structs, run ranges to run-based ones
+			if ( tagit->second->mode() != ( byRun ? 2 : 1 ) ) { continue; }
+
+			std::string tbname = tagit->second->tbname(), pid = tagit->second->id();
+			// table names and flavors are inlined into the statement
+			if ( sanitize_alnumuscore( std::as_const( tbname ) ) != tbname
+					|| std::any_of( lookup_flavors.begin(), lookup_flavors.end(), []( const auto& f ) { return sanitize_alnumuscore( f ) != f; } ) ) {
+				continue;
+			}
+
+			int64_t mt = maxEntryTime;
+			// check for path-specific maxEntryTime overrides
+			for ( const auto& [ opath, otime ] : maxEntryTimeOverrides ) {
+				if ( string_starts_with( dirpath, opath ) ) {
+					mt = otime;
+					break;
+				}
+			}
+			std::string mts = std::to_string( mt );
+
+			std::string query;
+			if ( byRun ) {
+				query = "SELECT id, uri, bt, et, ct, dt, run, seq, fmt, flavor, 0 AS nbt FROM cdb_iov_" + tbname + " "
+					+ "WHERE flavor IN ('" + implode( lookup_flavors, "','" ) + "') "
+					+ "AND run >= " + std::to_string( rangeBegin ) + " AND run <= " + std::to_string( rangeEnd )
+					+ ( mt ? " AND ct <= " + mts + " AND ( dt = 0 OR dt > " + mts + " )" : "" );
 			} else {
-				unfolded_paths.insert( path );
+				// payloads starting before the range end, minus open-ended ones superseded before the range begins
+				query = std::string( "SELECT * FROM ( SELECT i.id, i.uri, i.bt, i.et, i.ct, i.dt, i.run, i.seq, i.fmt, i.flavor, " )
+					+ "( SELECT MIN(n.bt) FROM cdb_iov_" + tbname + " n WHERE n.flavor = i.flavor AND n.bt > i.bt"
+					+ ( mt ? " AND n.ct <= " + mts + " AND ( n.dt = 0 OR n.dt > " + mts + " )" : "" ) + " ) AS nbt "
+					+ "FROM cdb_iov_" + tbname + " i "
+					+ "WHERE i.flavor IN ('" + implode( lookup_flavors, "','" ) + "') "
+					+ "AND i.bt <= " + std::to_string( rangeEnd )
+					+ ( mt ? " AND i.ct <= " + mts + " AND ( i.dt = 0 OR i.dt > " + mts + " )" : "" ) + " ) q "
+					+ "WHERE et > " + std::to_string( rangeBegin ) + " OR ( et = 0 AND ( nbt IS NULL OR nbt > " + std::to_string( rangeBegin ) + " ) )";
+			}
+
+			try {
+				std::string id{""}, uri{""}, fmt{""}, flavor{""};
+				uint64_t bt = 0, et = 0, ct = 0, dt = 0, run = 0, seq = 0, nbt = 0;
+				soci::indicator nbt_ind{soci::i_null};
+				statement st = ( session->prepare << query,
+						into(id), into(uri), into(bt), into(et), into(ct), into(dt), into(run), into(seq), into(fmt), into(flavor), into(nbt, nbt_ind) );
+				st.execute();
+				while ( st.fetch() ) {
+					// open-ended payloads are valid until the next one begins
+					uint64_t end_time = ( byRun || et ) ? et : ( ( nbt_ind == soci::i_ok && nbt ) ? nbt : static_cast<uint64_t>( std::numeric_limits<int64_t>::max() ) );
+					auto p = std::make_shared<Payload>(
+							id, pid, flavor, structName, directory,
+							ct, bt, end_time, dt, run, seq
+							);
+					p->setURI( uri, fmt );
+					res.push_back( p );
+				}
+			} catch( std::exception const & e ) {
+				CDBNPP_LOG_ERROR << "prefetch of " << dirpath << " failed: " << e.what() << std::endl;
 			}
 		}
 
-		for ( const auto& path : unfolded_paths ) {
-			Result<SPayloadPtr_t> rc = getPayload( path, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
-			if ( rc.valid() ) {
-				SPayloadPtr_t p = rc.get();
-				res.insert({ p->directory() + "/" + p->structName(), p });
+		return res;
+	}
+
+	PayloadResults_t PayloadAdapterDb::getPayloadsBatched( const TagSnapshot& snapshot, const std::set<std::string>& paths, const std::vector<std::string>& service_flavors,
+			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t eventRun, int64_t eventSeq ) {
+		PayloadResults_t res;
+
+		std::vector<IovLookup> lookups;
+		lookups.reserve( paths.size() );
+		for ( const auto& path : paths ) {
+			auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
+			const std::vector<std::string>& lookup_flavors = flavors.size() ? flavors : service_flavors;
+			if ( !is_path_valid || !directory.size() || !structName.size() || !lookup_flavors.size() ) { continue; }
+
+			std::string dirpath = directory + "/" + structName;
+			auto tagit = snapshot.paths.find( dirpath );
+			if ( tagit == snapshot.paths.end() || !tagit->second->tbname().size() ) { continue; }
+
+			IovLookup lookup;
+			lookup.path = path;
+			lookup.directory = directory;
+			lookup.structName = structName;
+			lookup.tbname = tagit->second->tbname();
+			lookup.pid = tagit->second->id();
+			lookup.flavors = lookup_flavors;
+			lookup.mode = tagit->second->mode();
+			lookup.maxEntryTime = maxEntryTime;
+			// check for path-specific maxEntryTime overrides
+			for ( const auto& [ opath, otime ] : maxEntryTimeOverrides ) {
+				if ( string_starts_with( dirpath, opath ) ) {
+					lookup.maxEntryTime = otime;
+					break;
+				}
+			}
+
+			// table names and flavors are inlined into the batched statement, anything unusual is resolved by getPayload
+			lookup.fallback = sanitize_alnumuscore( std::as_const( lookup.tbname ) ) != lookup.tbname
+				|| std::any_of( lookup.flavors.begin(), lookup.flavors.end(), []( const auto& f ) { return sanitize_alnumuscore( f ) != f; } );
+			lookups.push_back( std::move( lookup ) );
+		}
+
+		// group lookups into batches of at most batchSize() subqueries, one subquery per flavor
+		auto make_batches = [ this, &lookups ]( auto&& include ) {
+			std::vector<std::vector<size_t>> batches;
+			size_t queries = 0, batch_size = batchSize();
+			for ( size_t idx = 0; idx < lookups.size(); ++idx ) {
+				if ( lookups[idx].fallback || !include( lookups[idx] ) ) { continue; }
+				if ( batches.empty() || ( queries && queries + lookups[idx].flavors.size() > batch_size ) ) {
+					batches.emplace_back();
+					queries = 0;
+				}
+				batches.back().push_back( idx );
+				queries += lookups[idx].flavors.size();
+			}
+			return batches;
+		};
+
+		for ( const auto& batch : make_batches( []( const IovLookup& ) { return true; } ) ) {
+			Result<bool> rc = resolveIovBatch( lookups, batch, eventTime, eventRun, eventSeq );
+			if ( rc.invalid() ) {
+				CDBNPP_LOG_ERROR << "batched iov lookup failed, falling back to per-path lookups: " << rc.msg() << std::endl;
+				for ( size_t idx : batch ) { lookups[idx].fallback = true; }
+			}
+		}
+
+		// time-based payloads without endTime are valid until the next one begins
+		auto needs_end_time = []( const IovLookup& l ) { return l.found && l.mode == 1 && l.et == 0; };
+		for ( const auto& batch : make_batches( needs_end_time ) ) {
+			Result<bool> rc = resolveEndTimeBatch( lookups, batch, eventTime );
+			if ( rc.invalid() ) {
+				CDBNPP_LOG_ERROR << "batched end time lookup failed, falling back to per-path lookups: " << rc.msg() << std::endl;
+				for ( size_t idx : batch ) { lookups[idx].fallback = true; }
+			}
+		}
+
+		for ( const auto& l : lookups ) {
+			if ( l.fallback ) {
+				Result<SPayloadPtr_t> rc = getPayload( l.path, service_flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, eventRun, eventSeq );
+				if ( rc.valid() ) {
+					SPayloadPtr_t p = rc.get();
+					res.insert({ p->directory() + "/" + p->structName(), p });
+				}
+				continue;
+			}
+			if ( !l.found ) { continue; }
+			auto p = std::make_shared<Payload>(
+					l.id, l.pid, l.flavors[ l.flavorIdx ], l.structName, l.directory,
+					l.ct, l.bt, l.et, l.dt, l.run, l.seq
+					);
+			p->setURI( l.uri, l.fmt );
+			res.insert({ l.directory + "/" + l.structName, p });
+		}
+
+		return res;
+	}
+
+	Result<bool> PayloadAdapterDb::resolveIovBatch( std::vector<IovLookup>& lookups, const std::vector<size_t>& batch,
+			int64_t eventTime, int64_t eventRun, int64_t eventSeq ) {
+		Result<bool> res;
+
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("get");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
+
+			// one "latest matching row" subquery per (lookup, flavor), tagged with the lookup and flavor index
+			bool single_query = singleQueryIov( session.dbtype() );
+			std::vector<std::string> subqueries;
+			for ( size_t idx : batch ) {
+				const IovLookup& l = lookups[idx];
+				std::string mt = std::to_string( l.maxEntryTime );
+				std::string mt_filter = l.maxEntryTime ? " AND ct <= " + mt + " AND ( dt = 0 OR dt > " + mt + " )" : "";
+				std::string filter = ( l.mode == 2
+						? "run = " + std::to_string( eventRun ) + " AND seq = " + std::to_string( eventSeq )
+						: "bt <= " + std::to_string( eventTime ) + " AND ( et = 0 OR et > " + std::to_string( eventTime ) + " )" )
+					+ mt_filter
+					+ ( l.mode == 2 ? " ORDER BY ct DESC" : " ORDER BY bt DESC" );
+				for ( size_t fidx = 0; fidx < l.flavors.size(); ++fidx ) {
+					// next beginTime of open-ended time-based payloads, saves the resolveEndTimeBatch round-trip
+					std::string next_bt = ( single_query && l.mode == 1 )
+						? "CASE WHEN et = 0 THEN ( SELECT MIN(n.bt) FROM cdb_iov_" + l.tbname + " n WHERE n.flavor = '" + l.flavors[fidx] + "'"
+							+ " AND n.bt > " + std::to_string( eventTime )
+							+ ( l.maxEntryTime ? " AND n.ct <= " + mt + " AND ( n.dt = 0 OR n.dt > " + mt + " )" : "" ) + " ) END"
+						: "NULL";
+					subqueries.push_back( "SELECT * FROM ( SELECT " + std::to_string( idx ) + " AS qp, " + std::to_string( fidx ) + " AS qf, "
+						+ "id, uri, bt, et, ct, dt, run, seq, fmt, " + next_bt + " AS nbt FROM cdb_iov_" + l.tbname + " "
+						+ "WHERE flavor = '" + l.flavors[fidx] + "' AND " + filter + " LIMIT 1 ) q" + std::to_string( subqueries.size() ) );
+				}
+			}
+			if ( subqueries.empty() ) {
+				res = true;
+				return res;
+			}
+
+			auto query_start = std::chrono::steady_clock::now();
+			try {
+				int qp{0}, qf{0};
+				std::string id{""}, uri{""}, fmt{""};
+				uint64_t bt = 0, et = 0, ct = 0, dt = 0, run = 0, seq = 0, nbt = 0;
+				soci::indicator nbt_ind{soci::i_null};
+				statement st = ( session->prepare << implode( subqueries, " UNION ALL " ),
+						into(qp), into(qf), into(id), into(uri), into(bt), into(et), into(ct), into(dt), into(run), into(seq), into(fmt), into(nbt, nbt_ind) );
+				st.execute();
+				while ( st.fetch() ) {
+					if ( qp < 0 || static_cast<size_t>(qp) >= lookups.size() ) { continue; }
+					IovLookup& l = lookups[qp];
+					// lower flavor index wins
+					if ( l.found && l.flavorIdx <= static_cast<size_t>(qf) ) { continue; }
+					l.found = true;
+					l.flavorIdx = qf;
+					l.id = id; l.uri = uri; l.fmt = fmt;
+					l.bt = bt; l.et = et; l.ct = ct; l.dt = dt; l.run = run; l.seq = seq;
+					if ( single_query && l.mode == 1 && l.et == 0 ) {
+						l.et = ( nbt_ind == soci::i_ok && nbt ) ? nbt : static_cast<uint64_t>( std::numeric_limits<int64_t>::max() );
+					}
+				}
+				reportQuery( session, "get", query_start, true );
+			} catch( std::exception const & e ) {
+				reportQuery( session, "get", query_start, false );
+				res.setMsg( "database exception: " + std::string(e.what()) );
+				return res;
 			}
+		} // RAII scope block for the pooled db session
+
+		res = true;
+		return res;
+	}
+
+	Result<bool> PayloadAdapterDb::resolveEndTimeBatch( std::vector<IovLookup>& lookups, const std::vector<size_t>& batch, int64_t eventTime ) {
+		Result<bool> res;
+
+		// endTime is the beginTime of the first payload of the same flavor starting after eventTime
+		std::vector<std::string> subqueries;
+		for ( size_t idx : batch ) {
+			const IovLookup& l = lookups[idx];
+			std::string mt = std::to_string( l.maxEntryTime );
+			subqueries.push_back( "SELECT * FROM ( SELECT " + std::to_string( idx ) + " AS qp, bt FROM cdb_iov_" + l.tbname + " "
+				+ "WHERE flavor = '" + l.flavors[ l.flavorIdx ] + "' AND bt > " + std::to_string( eventTime )
+				+ ( l.maxEntryTime ? " AND ct <= " + mt + " AND ( dt = 0 OR dt > " + mt + " )" : "" )
+				+ " ORDER BY bt ASC LIMIT 1 ) q" + std::to_string( subqueries.size() ) );
+		}
+		if ( subqueries.empty() ) {
+			res = true;
+			return res;
 		}
 
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("get");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
+			auto query_start = std::chrono::steady_clock::now();
+			try {
+				int qp{0};
+				uint64_t bt = 0;
+				statement st = ( session->prepare << implode( subqueries, " UNION ALL " ), into(qp), into(bt) );
+				st.execute();
+				while ( st.fetch() ) {
+					if ( qp < 0 || static_cast<size_t>(qp) >= lookups.size() ) { continue; }
+					lookups[qp].et = bt;
+				}
+				reportQuery( session, "get", query_start, true );
+			} catch( std::exception const & e ) {
+				reportQuery( session, "get", query_start, false );
+				res.setMsg( "database exception: " + std::string(e.what()) );
+				return res;
+			}
+		} // RAII scope block for the pooled db session
+
+		for ( size_t idx : batch ) {
+			if ( !lookups[idx].et ) {
+				lookups[idx].et = static_cast<uint64_t>( std::numeric_limits<int64_t>::max() );
+			}
+		}
+
+		res = true;
 		return res;
 	}
 
+	bool PayloadAdapterDb::singleQueryIov( const std::string& dbtype ) {
+		if ( mConfig["adapters"]["db"].contains("config") && mConfig["adapters"]["db"]["config"].contains("single_query_iov")
+				&& !mConfig["adapters"]["db"]["config"]["single_query_iov"].get<bool>() ) {
+			return false;
+		}
+		// scalar subqueries in the select list are known to work there, other backends use a separate end time query
+		return dbtype == "sqlite3" || dbtype == "mysql" || dbtype == "postgresql";
+	}
+
+	size_t PayloadAdapterDb::batchSize() {
+		if ( mConfig["adapters"]["db"].contains("config") && mConfig["adapters"]["db"]["config"].contains("batch_size") ) {
+			return mConfig["adapters"]["db"]["config"]["batch_size"].get<size_t>();
+		}
+		return 100;
+	}
+
 	Result<SPayloadPtr_t> PayloadAdapterDb::getPayload( const std::string& path, const std::vector<std::string>& service_flavors,
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t eventRun, int64_t eventSeq ) {
 		Result<SPayloadPtr_t> res;
@@ -66,13 +409,10 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("get") ) {
-			res.setMsg( "cannot switch to GET mode");
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot ensure database connection");
+		if ( !hasAccess("get") ) {
+			res.setMsg( "cannot switch to GET mode");
 			return res;
 		}
 
@@ -111,8 +451,8 @@ namespace CDB {
 		}
 
 		// get tag
-		auto tagit = mPaths.find( dirpath );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( dirpath );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag for the " + dirpath );
 			return res;
 		}
@@ -124,96 +464,53 @@ namespace CDB {
 			return res;
 		}
 
+		SessionLease session = leaseSession("get");
+		if ( !session ) {
+			res.setMsg( "cannot lease database session" );
+			return res;
+		}
+		auto query_start = std::chrono::steady_clock::now();
+
 		for ( const auto& flavor : ( flavors.size() ? flavors : service_flavors ) ) {
 			std::string id{""}, uri{""}, fmt{""};
 			uint64_t bt = 0, et = 0, ct = 0, dt = 0, run = 0, seq = 0, mode = tagit->second->mode();
 
-			if ( mode == 2 ) {
-				// fetch id, run, seq
-
-				{ // RAII scope block for the db access mutex
-					const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
-					try {
-						std::string query = "SELECT id, uri, bt, et, ct, dt, run, seq, fmt FROM cdb_iov_" + tbname + " "
-							+ "WHERE "
-							+ "flavor = :flavor "
-							+ "AND run = :run "
-							+ "AND seq = :seq "
-							+ ( maxEntryTime ? "AND ct <= :mt " : "" )
-							+ ( maxEntryTime ? "AND ( dt = 0 OR dt > :mt ) " : "" )
-							+ "ORDER BY ct DESC LIMIT 1";
-
-						if ( maxEntryTime ) {
-							mSession->once << query, into(id), into(uri), into(bt), into(et), into(ct), into(dt), into(run), into(seq), into(fmt),
-								use( flavor, "flavor"), use( eventRun, "run" ), use( eventSeq, "seq" ), use( maxEntryTime, "mt" );
-						} else {
-							mSession->once << query, into(id), into(uri), into(bt), into(et), into(ct), into(dt), into(run), into(seq), into(fmt),
-								use( flavor, "flavor"), use( eventRun, "run" ), use( eventSeq, "seq" );
-						}
-					} catch( std::exception const & e ) {
-						res.setMsg( "database exception: " + std::string(e.what()) );
-						return res;
-					}
-				} // RAII scope block for the db access mutex
-
-				if ( !id.size() ) { continue; } // nothing found
-
-			} else if ( mode == 1 ) {
-				// fetch id, bt, et
-				{ // RAII scope block for the db access mutex
-					const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
-					try {
-						std::string query = "SELECT id, uri, bt, et, ct, dt, run, seq, fmt FROM cdb_iov_" + tbname + " "
-							+ "WHERE "
-							+ "flavor = :flavor "
-							+ "AND bt <= :et AND ( et = 0 OR et > :et ) "
-							+ ( maxEntryTime ? "AND ct <= :mt " : "" )
-							+ ( maxEntryTime ? "AND ( dt = 0 OR dt > :mt ) " : "" )
-							+ "ORDER BY bt DESC LIMIT 1";
-						if ( maxEntryTime ) {
-							mSession->once << query, into(id), into(uri), into(bt), into(et), into(ct), into(dt), into(run), into(seq), into(fmt),
-								use( flavor, "flavor"), use( eventTime, "et" ), use( maxEntryTime, "mt" );
-						} else {
-							mSession->once << query, into(id), into(uri), into(bt), into(et), into(ct), into(dt), into(run), into(seq), into(fmt),
-								use( flavor, "flavor"), use( eventTime, "et" );
-						}
-					} catch( std::exception const & e ) {
-						res.setMsg( "database exception: " + std::string(e.what()) );
-						return res;
-					}
-				} // RAII scope block for the db access mutex
-
-				if ( !id.size() ) { continue; } // nothing found
-
-				if ( et == 0 ) {
-					// if no endTime, do another query to establish endTime
-					{ // RAII scope block for the db access mutex
-						const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
-						try {
-							std::string query = "SELECT bt FROM cdb_iov_" + tbname + " "
-								+ "WHERE "
-								+ "flavor = :flavor "
-								+ "AND bt >= :et "
-								+ "AND ( et = 0 OR et < :et )"
-								+ ( maxEntryTime ? "AND ct <= :mt " : "" )
-								+ ( maxEntryTime ? "AND ( dt = 0 OR dt > :mt ) " : "" )
-								+ "ORDER BY bt ASC LIMIT 1";
-							if ( maxEntryTime ) {
-								mSession->once << query, into(et),
-									use( flavor, "flavor"), use( eventTime, "et" ), use( maxEntryTime, "mt" );
-							} else {
-								mSession->once << query, into(et),
-									use( flavor, "flavor"), use( eventTime, "et" );
-							}
-						} catch( std::exception const & e ) {
-							res.setMsg( "database exception: " + std::string(e.what()) );
-							return res;
+			try {
+				if ( mode == 2 ) {
+					// fetch id, run, seq
+					IovStatement& q = iovStatement( session, tbname, IovQuery::ByRun, maxEntryTime != 0 );
+					q.flavor = flavor; q.eventRun = eventRun; q.eventSeq = eventSeq; q.maxEntryTime = maxEntryTime;
+					if ( !q.st.execute(true) ) { continue; } // nothing found
+					id = q.id; uri = q.uri; fmt = q.fmt;
+					bt = q.bt; et = q.et; ct = q.ct; dt = q.dt; run = q.run; seq = q.seq;
+
+				} else if ( mode == 1 ) {
+					// fetch id, bt, et, and the next beginTime in the same statement where the backend allows it
+					bool single_query = singleQueryIov( session.dbtype() );
+					IovStatement& q = iovStatement( session, tbname, single_query ? IovQuery::ByTimeWithEnd : IovQuery::ByTime, maxEntryTime != 0 );
+					q.flavor = flavor; q.eventTime = eventTime; q.maxEntryTime = maxEntryTime;
+					if ( !q.st.execute(true) ) { continue; } // nothing found
+					id = q.id; uri = q.uri; fmt = q.fmt;
+					bt = q.bt; et = q.et; ct = q.ct; dt = q.dt; run = q.run; seq = q.seq;
+
+					if ( et == 0 && single_query ) {
+						et = ( q.nbtInd == soci::i_ok && q.nbt ) ? q.nbt : static_cast<uint64_t>( std::numeric_limits<int64_t>::max() );
+					} else if ( et == 0 ) {
+						// if no endTime, do another query to establish endTime
+						IovStatement& nq = iovStatement( session, tbname, IovQuery::EndTime, maxEntryTime != 0 );
+						nq.flavor = flavor; nq.eventTime = eventTime; nq.maxEntryTime = maxEntryTime;
+						et = nq.st.execute(true) ? nq.bt : 0;
+						if ( !et ) {
+							et = static_cast<uint64_t>( std::numeric_limits<int64_t>::max() );
 						}
-					} // RAII scope block for the db access mutex
-					if ( !et ) {
-						et = std::numeric_limits<uint64_t>::max();
 					}
 				}
+			} catch( std::exception const & e ) {
+				// statements of a failed session may be unusable, prepare them again on the next call
+				session.statements().clear();
+				reportQuery( session, "get", query_start, false );
+				res.setMsg( "database exception: " + std::string(e.what()) );
+				return res;
 			}
 
 			// create payload ptr, populate with data
@@ -221,8 +518,9 @@ namespace CDB {
 					id, pid, flavor, structName, directory,
 					ct, bt, et, dt, run, seq
 					);
-			p->setURI( uri );
+			p->setURI( uri, fmt );
 
+			reportQuery( session, "get", query_start, true );
 			res = p;
 			return res;
 		}
@@ -230,6 +528,70 @@ namespace CDB {
 		return res;
 	}
 
+	PayloadAdapterDb::IovStatement& PayloadAdapterDb::iovStatement( SessionLease& session, const std::string& tbname, IovQuery query, bool has_mt ) {
+		std::string key = tbname + ":" + std::to_string( static_cast<int>( query ) ) + ":" + ( has_mt ? "1" : "0" );
+		IovStatementCache_t& cache = session.statements();
+		auto it = cache.find( key );
+		if ( it != cache.end() ) { return *it->second; }
+
+		auto stmt = std::make_unique<IovStatement>( *session );
+		IovStatement& q = *stmt;
+		std::string sql;
+		if ( query == IovQuery::EndTime ) {
+			sql = "SELECT bt FROM cdb_iov_" + tbname + " "
+				+ "WHERE "
+				+ "flavor = :flavor "
+				+ "AND bt > :et "
+				+ ( has_mt ? "AND ct <= :mt " : "" )
+				+ ( has_mt ? "AND ( dt = 0 OR dt > :mt ) " : "" )
+				+ "ORDER BY bt ASC LIMIT 1";
+			q.st.exchange( into( q.bt ) );
+			q.st.exchange( use( q.flavor, "flavor" ) );
+			q.st.exchange( use( q.eventTime, "et" ) );
+		} else {
+			// endTime of an open-ended payload is the beginTime of the next one, see the EndTime query
+			std::string next_bt = query != IovQuery::ByTimeWithEnd ? "" : std::string( ", CASE WHEN et = 0 THEN ( " )
+				+ "SELECT MIN(n.bt) FROM cdb_iov_" + tbname + " n "
+				+ "WHERE n.flavor = :flavor AND n.bt > :et "
+				+ ( has_mt ? "AND n.ct <= :mt AND ( n.dt = 0 OR n.dt > :mt ) " : "" )
+				+ ") END AS nbt";
+			sql = "SELECT id, uri, bt, et, ct, dt, run, seq, fmt" + next_bt + " FROM cdb_iov_" + tbname + " "
+				+ "WHERE "
+				+ "flavor = :flavor "
+				+ ( query == IovQuery::ByRun ? "AND run = :run AND seq = :seq " : "AND bt <= :et AND ( et = 0 OR et > :et ) " )
+				+ ( has_mt ? "AND ct <= :mt " : "" )
+				+ ( has_mt ? "AND ( dt = 0 OR dt > :mt ) " : "" )
+				+ ( query == IovQuery::ByRun ? "ORDER BY ct DESC LIMIT 1" : "ORDER BY bt DESC LIMIT 1" );
+			q.st.exchange( into( q.id ) );
+			q.st.exchange( into( q.uri ) );
+			q.st.exchange( into( q.bt ) );
+			q.st.exchange( into( q.et ) );
+			q.st.exchange( into( q.ct ) );
+			q.st.exchange( into( q.dt ) );
+			q.st.exchange( into( q.run ) );
+			q.st.exchange( into( q.seq ) );
+			q.st.exchange( into( q.fmt ) );
+			if ( query == IovQuery::ByTimeWithEnd ) {
+				q.st.exchange( into( q.nbt, q.nbtInd ) );
+			}
+			q.st.exchange( use( q.flavor, "flavor" ) );
+			if ( query == IovQuery::ByRun ) {
+				q.st.exchange( use( q.eventRun, "run" ) );
+				q.st.exchange( use( q.eventSeq, "seq" ) );
+			} else {
+				q.st.exchange( use( q.eventTime, "et" ) );
+			}
+		}
+		if ( has_mt ) {
+			q.st.exchange( use( q.maxEntryTime, "mt" ) );
+		}
+		q.st.alloc();
+		q.st.prepare( sql );
+		q.st.define_and_bind();
+
+		return *cache.insert({ key, std::move( stmt ) }).first->second;
+	}
+
 	Result<std::string> PayloadAdapterDb::setPayload( const SPayloadPtr_t& payload ) {
 		Result<std::string> res;
 
@@ -243,6 +605,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 
 		if ( payload->dataSize() && payload->format() != "dat" ) {
 			// validate json against schema if exists
@@ -257,8 +621,8 @@ namespace CDB {
 		}
 
 		// get tag, fetch tbname
-		auto tagit = mPaths.find( payload->directory() + "/" + payload->structName() );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( payload->directory() + "/" + payload->structName() );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find payload tag in the database: " + payload->directory() + "/" + payload->structName() );
 			return res;
 		}
@@ -267,42 +631,51 @@ namespace CDB {
 		sanitize_alnumuscore(tbname);
 
 		// unpack values for SOCI
-		std::string id = payload->id(), pid = payload->pid(), flavor = payload->flavor(), fmt = payload->format();
+		std::string id = payload->id(), pid = payload->pid(), flavor = payload->flavor(), fmt = payload->storedFormat();
 		int64_t ct = std::time(nullptr), bt = payload->beginTime(), et = payload->endTime(),
 			run = payload->run(), seq = payload->seq();
 
-		if ( !setAccessMode("set") ) {
+		if ( !hasAccess("set") ) {
 			res.setMsg( "cannot switch to SET mode");
 			return res;
 		}
 
-		if ( !ensureConnection() ) {
-			res.setMsg("db adapter cannot connect to the database");
-			return res;
-		}
-
 		// insert iov into cdb_iov_<table-name>, data into cdb_data_<table-name>
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("set");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
+
+			// probed before the transaction, a failed probe would abort it on some backends
+			bool store_blob = !payload->URI().size() && payload->dataSize() && blobStorage( session.dbtype() ) && hasBlobColumn( session, tbname );
 
 			try {
 				int64_t dt = 0;
-				transaction tr( *mSession.get() );
+				transaction tr( *session );
 
 				if ( !payload->URI().size() && payload->dataSize() ) {
 					// if uri is empty and data is not empty, store data locally to the database
 					size_t data_size = payload->dataSize();
-					std::string data = base64::encode( payload->data() );
-
-					mSession->once << ( "INSERT INTO cdb_data_" + tbname + " ( id, pid, ct, dt, data, size ) VALUES ( :id, :pid, :ct, :dt, :data, :size )" )
-						,use(id), use(pid), use(ct), use(dt), use(data), use(data_size);
+					if ( store_blob ) {
+						std::string empty{};
+						bindBlob( session, payload->storedData(), [&]( auto& bdata ) {
+								session->once << ( "INSERT INTO cdb_data_" + tbname + " ( id, pid, ct, dt, data, bdata, size ) VALUES ( :id, :pid, :ct, :dt, :data, :bdata, :size )" )
+									,use(id), use(pid), use(ct), use(dt), use(empty), use(bdata), use(data_size);
+								});
+					} else {
+						std::string data = base64::encode( payload->storedData() );
+						session->once << ( "INSERT INTO cdb_data_" + tbname + " ( id, pid, ct, dt, data, size ) VALUES ( :id, :pid, :ct, :dt, :data, :size )" )
+							,use(id), use(pid), use(ct), use(dt), use(data), use(data_size);
+					}
 
-					payload->setURI( "db://" + tbname + "/" + id );
+					payload->setURI( "db://" + tbname + "/" + id, fmt );
 				}
 
 				std::string uri = payload->URI();
-				mSession->once << ( "INSERT INTO cdb_iov_" + tbname + " ( id, pid, flavor, ct, bt, et, dt, run, seq, uri, fmt ) VALUES ( :id, :pid, :flavor, :ct, :bt, :et, :dt, :run, :seq, :uri, :bin )" )
+				session->once << ( "INSERT INTO cdb_iov_" + tbname + " ( id, pid, flavor, ct, bt, et, dt, run, seq, uri, fmt ) VALUES ( :id, :pid, :flavor, :ct, :bt, :et, :dt, :run, :seq, :uri, :bin )" )
 					,use(id), use(pid), use(flavor), use(ct), use(bt), use(et), use(dt), use(run), use(seq), use(uri), use(fmt);
 
 				tr.commit();
@@ -312,7 +685,7 @@ namespace CDB {
 				return res;
 			}
 
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		return res;
 	}
@@ -330,19 +703,16 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("admin") ) {
-			res.setMsg( "cannot switch to ADMIN mode");
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("db adapter cannot connect to the database");
+		if ( !hasAccess("admin") ) {
+			res.setMsg( "cannot switch to ADMIN mode");
 			return res;
 		}
 
 		// get tag, fetch tbname
-		auto tagit = mPaths.find( payload->directory() + "/" + payload->structName() );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( payload->directory() + "/" + payload->structName() );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find payload tag in the database: " + payload->directory() + "/" + payload->structName() );
 			return res;
 		}
@@ -352,10 +722,14 @@ namespace CDB {
 		std::string id = payload->id();
 		sanitize_alnumdash(id);
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 			try {
-				mSession->once << "UPDATE cdb_iov_" + tbname + " SET dt = :dt WHERE id = :id",
+				session->once << "UPDATE cdb_iov_" + tbname + " SET dt = :dt WHERE id = :id",
 					use(deactiveTime), use( id );
 			} catch ( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
@@ -376,6 +750,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
 
 		if ( !flavors.size() ) {
@@ -389,8 +765,8 @@ namespace CDB {
 		}
 
 		// see if path exists in the known tags map
-		auto tagit = mPaths.find( directory + "/" + structName );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( directory + "/" + structName );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "path does not exist in the db. path: " + path );
 			return res;
 		}
@@ -423,13 +799,10 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("admin") ) {
-			res.setMsg("cannot set ADMIN mode");
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot ensure connection");
+		if ( !hasAccess("admin") ) {
+			res.setMsg("cannot set ADMIN mode");
 			return res;
 		}
 
@@ -441,8 +814,8 @@ namespace CDB {
 			return res;
 		}
 		std::string tag_pid = "";
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag path in the database... path: " + sanitized_path );
 			return res;
 		}
@@ -455,10 +828,14 @@ namespace CDB {
 			return res;
 		}
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 			try {
-				mSession->once << "DELETE FROM cdb_schemas WHERE pid = :pid",
+				session->once << "DELETE FROM cdb_schemas WHERE pid = :pid",
 					use(tag_pid);
 			} catch( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
@@ -473,23 +850,22 @@ namespace CDB {
 	Result<bool> PayloadAdapterDb::createDatabaseTables() {
 		Result<bool> res;
 
-		if ( !setAccessMode("admin") ) {
+		if ( !hasAccess("admin") ) {
 			res.setMsg( "cannot switch to ADMIN mode" );
 			return res;
 		}
 
-		if ( !ensureConnection() ) {
-			res.setMsg( "cannot connect to the database" );
-			return res;
-		}
-
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 			try {
-				transaction tr( *mSession.get() );
+				transaction tr( *session );
 				// cdb_tags
 				{
-					soci::ddl_type ddl = mSession->create_table("cdb_tags");
+					soci::ddl_type ddl = session->create_table("cdb_tags");
 					ddl.column("id", soci::dt_string, 36 )("not null");
 					ddl.column("pid", soci::dt_string, 36 )("not null");
 					ddl.column("name", soci::dt_string, 128 )("not null");
@@ -502,7 +878,7 @@ namespace CDB {
 				}
 				// cdb_schemas
 				{
-					soci::ddl_type ddl = mSession->create_table("cdb_schemas");
+					soci::ddl_type ddl = session->create_table("cdb_schemas");
 					ddl.column("id", soci::dt_string, 36 )("not null");
 					ddl.column("pid", soci::dt_string, 36 )("not null");
 					ddl.column("ct", soci::dt_unsigned_long_long )("not null");
@@ -516,7 +892,7 @@ namespace CDB {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		res = true;
 		return res;
@@ -525,24 +901,23 @@ namespace CDB {
 	Result<bool> PayloadAdapterDb::createIOVDataTables( const std::string& tablename, bool create_storage ) {
 		Result<bool> res;
 
-		if ( !setAccessMode("admin") ) {
+		if ( !hasAccess("admin") ) {
 			res.setMsg("cannot get ADMIN mode");
 			return res;
 		}
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot ensure connection");
-			return res;
-		}
-
-		{ //RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
 			try {
-				transaction tr( *mSession.get() );
+				transaction tr( *session );
 				// cdb_iov_<tablename>
 				{
-					soci::ddl_type ddl = mSession->create_table("cdb_iov_"+tablename);
+					soci::ddl_type ddl = session->create_table("cdb_iov_"+tablename);
 					ddl.column("id", soci::dt_string, 36 )("not null");
 					ddl.column("pid", soci::dt_string, 36 )("not null");
 					ddl.column("flavor", soci::dt_string, 128 )("not null");
@@ -558,12 +933,12 @@ namespace CDB {
 					ddl.unique("cdb_iov_"+tablename+"_id", "id");
 				}
 
-				mSession->once << "CREATE INDEX cdb_iov_" + tablename + "_ct ON cdb_iov_" + tablename + " (ct)";
+				session->once << "CREATE INDEX cdb_iov_" + tablename + "_ct ON cdb_iov_" + tablename + " (ct)";
 
 				if ( create_storage ) {
 					// cdb_data_<tablename>
 					{
-						soci::ddl_type ddl = mSession->create_table("cdb_data_"+tablename);
+						soci::ddl_type ddl = session->create_table("cdb_data_"+tablename);
 						ddl.column("id", soci::dt_string, 36 )("not null");
 						ddl.column("pid", soci::dt_string, 36 )("not null");
 						ddl.column("ct", soci::dt_unsigned_long_long )("not null");
@@ -573,8 +948,11 @@ namespace CDB {
 						ddl.primary_key("cdb_data_"+tablename+"_pk", "id,pid,dt");
 						ddl.unique("cdb_data_"+tablename+"_id", "id");
 					}
-					mSession->once << "CREATE INDEX cdb_data_" + tablename + "_pid ON cdb_data_" + tablename + " (pid)";
-					mSession->once << "CREATE INDEX cdb_data_" + tablename + "_ct ON cdb_data_" + tablename + " (ct)";
+					session->once << "CREATE INDEX cdb_data_" + tablename + "_pid ON cdb_data_" + tablename + " (pid)";
+					session->once << "CREATE INDEX cdb_data_" + tablename + "_ct ON cdb_data_" + tablename + " (ct)";
+					if ( blobStorage( session.dbtype() ) ) {
+						addBlobColumn( session, tablename );
+					}
 				}
 				tr.commit();
 			} catch( std::exception const & e ) {
@@ -582,7 +960,7 @@ namespace CDB {
 				return res;
 			}
 
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		res = true;
 		return res;
@@ -591,19 +969,18 @@ namespace CDB {
 	std::vector<std::string> PayloadAdapterDb::listDatabaseTables() {
 		std::vector<std::string> tables;
 
-		if ( !setAccessMode("admin") ) {
+		if ( !hasAccess("admin") ) {
 			return tables;
 		}
 
-		if ( !ensureConnection() ) {
-			return tables;
-		}
-
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				return tables;
+			}
 			try {
 				std::string name;
-				soci::statement st = (mSession->prepare_table_names(), into(name));
+				soci::statement st = (session->prepare_table_names(), into(name));
 				st.execute();
 				while (st.fetch()) {
 					tables.push_back( name );
@@ -612,7 +989,7 @@ namespace CDB {
 				// database exception: " << e.what()
 				tables.clear();
 			}
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		return tables;
 	}
@@ -622,114 +999,150 @@ namespace CDB {
 
 		std::vector<std::string> tables = listDatabaseTables();
 
-		if ( !setAccessMode("admin") ) {
+		if ( !hasAccess("admin") ) {
 			res.setMsg( "cannot switch to ADMIN mode" );
 			return res;
 		}
 
-		if ( !ensureConnection() ) {
-			res.setMsg( "cannot connect to the database" );
-			return res;
-		}
-
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 			try {
 				for ( const auto& tbname : tables ) {
-					mSession->drop_table( tbname );
+					session->drop_table( tbname );
 				}
 			} catch( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
 			res = true;
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		return res;
 	}
 
-	bool PayloadAdapterDb::setAccessMode( const std::string& mode ) {
-		if ( !hasAccess(mode) ) {
-			// cannot set access mode
-			return false;
-		}
-
-		if ( mAccessMode == mode ) {
-			return true;
-		}
+	bool PayloadAdapterDb::blobStorage( const std::string& dbtype ) {
+		return dbtype == "sqlite3" || dbtype == "mysql";
+	}
 
-		mAccessMode = mode;
+	bool PayloadAdapterDb::hasBlobColumn( SessionLease& session, const std::string& tbname ) {
+		{ // RAII scope block for the cache lock
+			const std::lock_guard<std::mutex> lock(mBlobMutex);
+			auto it = mBlobColumns.find( tbname );
+			if ( it != mBlobColumns.end() ) { return it->second; }
+		} // RAII scope block for the cache lock
 
-		if ( isConnected() ) {
-			return reconnect();
+		bool has_column = true;
+		try {
+			session->once << ( "SELECT bdata FROM cdb_data_" + tbname + " WHERE 1 = 0" );
+		} catch ( std::exception const & e ) {
+			has_column = false;
 		}
 
-		return true;
+		const std::lock_guard<std::mutex> lock(mBlobMutex);
+		mBlobColumns[ tbname ] = has_column;
+		return has_column;
 	}
 
-	void PayloadAdapterDb::disconnect() {
-		if ( !isConnected() ) { return; }
-		{ // RAII block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
-			try {
-				mSession->close();
-				mIsConnected = false;
-				mDbType = "";
-			} catch ( std::exception const & e ) {
-				// database exception, e.what()
-			}
-		} // RAII block for the db access mutex
+	void PayloadAdapterDb::addBlobColumn( SessionLease& session, const std::string& tbname ) {
+		// mysql BLOB stops at 64KB
+		session->once << ( "ALTER TABLE cdb_data_" + tbname + " ADD COLUMN bdata " + ( session.dbtype() == "mysql" ? "LONGBLOB" : "BLOB" ) + " NULL" );
+		const std::lock_guard<std::mutex> lock(mBlobMutex);
+		mBlobColumns[ tbname ] = true;
 	}
 
-	bool PayloadAdapterDb::connect( const std::string& dbtype, const std::string& host, int port,
-			const std::string& user, const std::string& pass, const std::string& dbname, const std::string& options ) {
-		if ( isConnected() ) {
-			disconnect();
-		}
+	Result<size_t> PayloadAdapterDb::migrateDataToBlob( const std::string& tbname ) {
+		Result<size_t> res;
 
-		{ // RAII block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		if ( !hasAccess("admin") ) {
+			res.setMsg( "cannot switch to ADMIN mode" );
+			return res;
+		}
 
-			if ( mSession == nullptr ) {
-				mSession = std::make_shared<soci::session>();
+		std::vector<std::string> tbnames{};
+		if ( tbname.size() ) {
+			tbnames.push_back( tbname );
+		} else {
+			for ( const auto& table : listDatabaseTables() ) {
+				if ( string_starts_with( table, "cdb_data_" ) ) {
+					tbnames.push_back( table.substr( 9 ) );
+				}
 			}
+		}
 
-			std::string connect_string{
-				dbtype + "://" + ( host.size() ? "host=" + host : "")
-					+ ( port > 0 ? " port=" + std::to_string(port) : "" )
-					+ ( user.size() ? " user=" + user : "" )
-					+ ( pass.size() ? " password=" + pass : "" )
-					+ ( dbname.size() ? " dbname=" + dbname : "" )
-					+ ( options.size() ? " " + options : "" )
-			};
+		size_t migrated = 0, batch_size = std::max( batchSize(), size_t(1) );
 
-			try {
-				mSession->open( connect_string );
-			} catch ( std::exception const & e ) {
-				// database exception: " << e.what()
-				return false;
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
+			if ( !blobStorage( session.dbtype() ) ) {
+				res.setMsg( "binary storage is not supported for " + session.dbtype() + ", data stays base64-encoded" );
+				return res;
 			}
 
-			mIsConnected = true;
-			mDbType = dbtype;
+			for ( const auto& name : tbnames ) {
+				try {
+					if ( !hasBlobColumn( session, name ) ) {
+						addBlobColumn( session, name );
+					}
 
-		} // RAII scope block for the db access mutex
+					// one transaction per batch, an interrupted migration resumes where it stopped
+					while ( true ) {
+						std::vector<std::pair<std::string, std::string>> rows{}; // id, base64 data
+						{
+							std::string id, data;
+							statement st = ( session->prepare << "SELECT id, data FROM cdb_data_" + name + " WHERE bdata IS NULL AND data <> '' LIMIT "
+								+ std::to_string( batch_size ), into(id), into(data) );
+							st.execute();
+							while ( st.fetch() ) {
+								rows.emplace_back( id, data );
+							}
+						}
+						if ( !rows.size() ) { break; }
+
+						transaction tr( *session );
+						for ( const auto& [ id, data ] : rows ) {
+							std::string empty{};
+							bindBlob( session, base64::decode( data ), [&]( auto& bdata ) {
+									session->once << ( "UPDATE cdb_data_" + name + " SET bdata = :bdata, data = :data WHERE id = :id" ), use(bdata), use(empty), use(id);
+									});
+						}
+						tr.commit();
+						migrated += rows.size();
+					}
+				} catch( std::exception const & e ) {
+					res.setMsg( "database exception while migrating cdb_data_" + name + ": " + std::string(e.what()) + ", rows migrated so far: " + std::to_string( migrated ) );
+					return res;
+				}
+			}
+		} // RAII scope block for the pooled db session
 
-		return true;
+		res = migrated;
+		return res;
 	}
 
-	bool PayloadAdapterDb::reconnect() {
-		if ( !hasAccess( mAccessMode ) ) {
-			return false;
-		}
-		if ( isConnected() ) {
-			disconnect();
+	PayloadAdapterDb::SessionLease::~SessionLease() {
+		if ( !mPool ) { return; }
+		mPool->leased.fetch_sub( 1, std::memory_order_relaxed );
+		mPool->pool.give_back( mPos );
+	}
+
+	int PayloadAdapterDb::accessModeIndex( const std::string& mode ) {
+		for ( size_t i = 0; i < ACCESS_MODES.size(); ++i ) {
+			if ( mode == ACCESS_MODES[i] ) { return static_cast<int>(i); }
 		}
+		return -1;
+	}
+
+	std::pair<std::string,std::string> PayloadAdapterDb::connectString( const nlohmann::json& node ) {
 		int port{0};
 		std::string dbtype{}, host{}, user{}, pass{}, dbname{}, options{};
-		nlohmann::json node;
-		size_t idx = RngS::Instance().random_inclusive<size_t>( 0, mConfig["adapters"]["db"][ mAccessMode ].size() - 1 );
-		node = mConfig["adapters"]["db"][ mAccessMode ][ idx ];
 		if ( node.contains("dbtype") ) {
 			dbtype = node["dbtype"];
 		}
@@ -751,7 +1164,134 @@ namespace CDB {
 		if ( node.contains("options") ) {
 			options = node["options"];
 		}
-		return connect( dbtype, host, port, user, pass, dbname, options );
+		return { dbtype, dbtype + "://" + ( host.size() ? "host=" + host : "")
+			+ ( port > 0 ? " port=" + std::to_string(port) : "" )
+			+ ( user.size() ? " user=" + user : "" )
+			+ ( pass.size() ? " password=" + pass : "" )
+			+ ( dbname.size() ? " dbname=" + dbname : "" )
+			+ ( options.size() ? " " + options : "" ) };
+	}
+
+	PayloadAdapterDb::SessionPool* PayloadAdapterDb::ensurePool( const std::string& mode ) {
+		int idx = accessModeIndex( mode );
+		if ( idx < 0 || !hasAccess( mode ) ) {
+			return nullptr;
+		}
+
+		SessionPool* pool = mPoolPtrs[idx].load( std::memory_order_acquire );
+		if ( pool ) { return pool; }
+
+		const std::lock_guard<std::mutex> lock(mPoolMutex);
+		pool = mPoolPtrs[idx].load( std::memory_order_acquire );
+		if ( pool ) { return pool; }
+
+		size_t pool_size = 1;
+		int timeout_ms = 60000;
+		if ( mConfig["adapters"]["db"].contains("config") ) {
+			const nlohmann::json& cfg = mConfig["adapters"]["db"]["config"];
+			if ( cfg.contains("pool_size") && cfg["pool_size"].contains( mode ) ) {
+				pool_size = std::max<size_t>( 1, cfg["pool_size"][mode].get<size_t>() );
+			}
+			if ( cfg.contains("pool_timeout_ms") ) {
+				timeout_ms = cfg["pool_timeout_ms"];
+			}
+		}
+
+		// sessions connect one after another, so the balancer learns from the earlier connects where to put the later ones;
+		// the pool hands out low positions first, which therefore go to the fastest servers
+		auto new_pool = std::make_unique<SessionPool>( pool_size, timeout_ms, mConfig["adapters"]["db"][ mode ].size() );
+		for ( size_t i = 0; i < pool_size; ++i ) {
+			if ( !openSession( *new_pool, i, mode ) ) {
+				return nullptr;
+			}
+		}
+
+		pool = new_pool.get();
+		mPools[idx] = std::move( new_pool );
+		mPoolPtrs[idx].store( pool, std::memory_order_release );
+		return pool;
+	}
+
+	bool PayloadAdapterDb::openSession( SessionPool& pool, size_t pos, const std::string& mode ) {
+		for ( size_t server : pool.balancer.ranked() ) {
+			auto [ dbtype, connect_string ] = connectString( mConfig["adapters"]["db"][ mode ][ server ] );
+			auto start = std::chrono::steady_clock::now();
+			try {
+				pool.pool.at(pos).open( connect_string );
+			} catch ( std::exception const & e ) {
+				pool.balancer.record( server, std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count(), false );
+				CDBNPP_LOG_ERROR << "cannot open " << mode << " session to " << dbtype << ": " << e.what() << std::endl;
+				continue;
+			}
+			pool.balancer.record( server, std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count(), true );
+			pool.dbtypes[pos] = dbtype;
+			pool.servers[pos] = server;
+			return true;
+		}
+		return false;
+	}
+
+	void PayloadAdapterDb::reportQuery( SessionLease& session, const std::string& mode, std::chrono::steady_clock::time_point start, bool ok ) {
+		SessionPool* pool = session.pool();
+		if ( !pool ) { return; }
+		// a failed query on a live connection is the query's fault, not the server's
+		bool connected = ok || session->is_connected();
+		pool->balancer.record( pool->servers[ session.pos() ],
+			std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count(), connected );
+		if ( connected ) { return; }
+
+		// reconnect, the balancer steers the session away from the failing server
+		session.statements().clear();
+		try {
+			session->close();
+		} catch ( ... ) {
+			// connection is gone already
+		}
+		if ( !openSession( *pool, session.pos(), mode ) ) {
+			CDBNPP_LOG_ERROR << "cannot reconnect " << mode << " session" << std::endl;
+		}
+	}
+
+	PayloadAdapterDb::SessionLease PayloadAdapterDb::leaseSession( const std::string& mode ) {
+		SessionPool* pool = ensurePool( mode );
+		if ( !pool ) {
+			return SessionLease();
+		}
+
+		size_t pos{0};
+		auto start = std::chrono::steady_clock::now();
+		if ( !pool->pool.try_lease( pos, pool->timeoutMs ) ) {
+			pool->timeouts.fetch_add( 1, std::memory_order_relaxed );
+			CDBNPP_LOG_ERROR << "timed out waiting for a " << mode << " session" << std::endl;
+			return SessionLease();
+		}
+		uint64_t waited = std::chrono::duration_cast<std::chrono::microseconds>( std::chrono::steady_clock::now() - start ).count();
+
+		pool->leases.fetch_add( 1, std::memory_order_relaxed );
+		pool->waitTotalUs.fetch_add( waited, std::memory_order_relaxed );
+		uint64_t wait_max = pool->waitMaxUs.load( std::memory_order_relaxed );
+		while ( waited > wait_max && !pool->waitMaxUs.compare_exchange_weak( wait_max, waited, std::memory_order_relaxed ) ) {}
+		size_t leased = pool->leased.fetch_add( 1, std::memory_order_relaxed ) + 1;
+		size_t peak = pool->peak.load( std::memory_order_relaxed );
+		while ( leased > peak && !pool->peak.compare_exchange_weak( peak, leased, std::memory_order_relaxed ) ) {}
+
+		return SessionLease( pool, pos );
+	}
+
+	DbPoolStats PayloadAdapterDb::poolStats( const std::string& mode ) {
+		DbPoolStats stats;
+		int idx = accessModeIndex( mode );
+		if ( idx < 0 ) { return stats; }
+		SessionPool* pool = mPoolPtrs[idx].load( std::memory_order_acquire );
+		if ( !pool ) { return stats; }
+		stats.size = pool->dbtypes.size();
+		stats.leased = pool->leased.load( std::memory_order_relaxed );
+		stats.peak = pool->peak.load( std::memory_order_relaxed );
+		stats.leases = pool->leases.load( std::memory_order_relaxed );
+		stats.timeouts = pool->timeouts.load( std::memory_order_relaxed );
+		stats.waitTotalUs = pool->waitTotalUs.load( std::memory_order_relaxed );
+		stats.waitMaxUs = pool->waitMaxUs.load( std::memory_order_relaxed );
+		return stats;
 	}
 
 	bool PayloadAdapterDb::ensureMetadata() {
@@ -759,58 +1299,133 @@ namespace CDB {
 	}
 
 	bool PayloadAdapterDb::downloadMetadata() {
-		if ( !ensureConnection() ) {
+		const std::lock_guard<std::mutex> lock(mMetadataMutex);
+		if ( mMetadataAvailable ) { return true; }
+
+		// warm start: only the changes since the snapshot was taken have to come from the database
+		std::string snapshot = metadataSnapshotPath();
+		if ( snapshot.size() ) {
+			mMetadata.load( snapshot, metadataSource() );
+		}
+
+		if ( !syncMetadata( false ) ) {
 			return false;
 		}
 
-		const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
-		if ( mMetadataAvailable ) { return true; }
+		// TODO: filter tags and paths based on maxEntryTime
+
+		mMetadataAvailable = true;
+		return true;
+	}
+
+	bool PayloadAdapterDb::refreshMetadata( bool full ) {
+		const std::lock_guard<std::mutex> lock(mMetadataMutex);
+		if ( !mMetadataAvailable && !full ) {
+			std::string snapshot = metadataSnapshotPath();
+			if ( snapshot.size() ) {
+				mMetadata.load( snapshot, metadataSource() );
+			}
+		}
+		if ( !syncMetadata( full ) ) {
+			return false;
+		}
+		mMetadataAvailable = true;
+		return true;
+	}
+
+	bool PayloadAdapterDb::syncMetadata( bool full ) {
+		if ( full ) {
+			mMetadata.clear();
+		}
+
+		int64_t since = mMetadata.rows.size() ? mMetadata.synced : 0;
+		Result<bool> rc = fetchMetadata( since );
+		if ( rc.invalid() ) {
+			CDBNPP_LOG_ERROR << "metadata download failed: " << rc.msg() << std::endl;
+			return false;
+		}
+		if ( !rc.get() ) {
+			// delta does not add up: tags imported with old timestamps or schemas dropped, start over
+			mMetadata.clear();
+			rc = fetchMetadata( 0 );
+			if ( rc.invalid() ) {
+				CDBNPP_LOG_ERROR << "metadata download failed: " << rc.msg() << std::endl;
+				return false;
+			}
+		}
 
-		mTags.clear();
-		mPaths.clear();
-		// download tags and populate lookup map: tag ID => Tag obj
+		// lookups still running keep the snapshot they started with, new ones pick this one up
+		std::atomic_store( &mTagSnapshot, mMetadata.build() );
+
+		std::string snapshot = metadataSnapshotPath();
+		if ( snapshot.size() && !mMetadata.save( snapshot, metadataSource() ) ) {
+			CDBNPP_LOG_ERROR << "cannot write metadata snapshot " << snapshot << std::endl;
+		}
+		return true;
+	}
+
+	Result<bool> PayloadAdapterDb::fetchMetadata( int64_t since ) {
+		Result<bool> res;
+
+		SessionLease session = leaseSession( hasAccess("get") ? "get" : "admin" );
+		if ( !session ) {
+			res.setMsg( "cannot lease database session" );
+			return res;
+		}
+
+		// download tags and schema ids, changed ones only if there is something to compare to
+		nlohmann::json rows = nlohmann::json::array();
+		int64_t tags_total = 0, schemas_total = 0, deactivated_total = 0;
 		try {
 			std::string id, name, pid, tbname, schema_id;
-			int64_t ct, dt, mode;
+			int64_t ct, dt, mode, schema_ct;
 			soci::indicator ind;
 
-			statement st = ( mSession->prepare << "SELECT t.id, t.name, t.pid, t.tbname, t.ct, t.dt, t.mode, COALESCE(s.id,'') as schema_id FROM cdb_tags t LEFT JOIN cdb_schemas s ON t.id = s.pid",
-					into(id), into(name), into(pid), into(tbname), into(ct), into(dt), into(mode), into(schema_id, ind) );
+			std::string query = "SELECT t.id, t.name, t.pid, t.tbname, t.ct, t.dt, t.mode, COALESCE(s.id,'') as schema_id, COALESCE(s.ct,0) as schema_ct "
+				"FROM cdb_tags t LEFT JOIN cdb_schemas s ON t.id = s.pid";
+			statement st = since > 0
+				? ( session->prepare << query + " WHERE t.ct >= :since_ct OR t.dt >= :since_dt OR s.ct >= :since_sct",
+					into(id), into(name), into(pid), into(tbname), into(ct), into(dt), into(mode), into(schema_id, ind), into(schema_ct),
+					use(since), use(since), use(since) )
+				: ( session->prepare << query,
+					into(id), into(name), into(pid), into(tbname), into(ct), into(dt), into(mode), into(schema_id, ind), into(schema_ct) );
 			st.execute();
 			while (st.fetch()) {
-				mTags.insert({ id, std::make_shared<Tag>( id, name, pid,	tbname,	ct,	dt, mode, ind == i_ok ? schema_id : "" ) });
+				rows.push_back({ { "id", id }, { "name", name }, { "pid", pid }, { "tbname", tbname }, { "ct", ct }, { "dt", dt }, { "mode", mode },
+					{ "schema_id", ind == i_ok ? schema_id : "" }, { "schema_ct", schema_ct } });
+			}
+
+			if ( since > 0 ) {
+				session->once << "SELECT COUNT(*) FROM cdb_tags", into(tags_total);
+				session->once << "SELECT COUNT(*) FROM cdb_tags t WHERE EXISTS ( SELECT 1 FROM cdb_schemas s WHERE s.pid = t.id )", into(schemas_total);
+				session->once << "SELECT COUNT(*) FROM cdb_tags WHERE dt <> 0", into(deactivated_total);
 			}
 		} catch ( std::exception const & e ) {
-			// database exception: " << e.what()
-			return false;
+			res.setMsg( "database exception: " + std::string(e.what()) );
+			return res;
 		}
 
-		if ( mTags.size() ) {
-			// erase tags that have parent id but no parent exists => side-effect of tag deactivation and/or maxEntryTime
-			// unfortunately, std::erase_if is C++20
-			container_erase_if( mTags, [this]( const auto item ) {
-					return ( item.second->pid().size() && mTags.find( item.second->pid() ) == mTags.end() );
-					});
-		}
+		mMetadata.merge( rows );
 
-		// parent-child: assign children and parents
-		if ( mTags.size() ) {
-			for ( auto& tag : mTags ) {
-				if ( !(tag.second)->pid().size() ) { continue; }
-				auto rc = mTags.find( ( tag.second )->pid() );
-				if ( rc == mTags.end() ) { continue; }
-				( tag.second )->setParent( rc->second );
-				( rc->second )->addChild( tag.second );
-			}
-			// populate lookup map: path => Tag obj
-			for ( const auto& tag : mTags ) {
-				mPaths.insert({ ( tag.second )->path(), tag.second });
-			}
-		}
+		// timestamps only tell about new and deactivated tags, counts catch what slipped through,
+		// i.e. a deactivation dated before the last sync
+		res = ( since == 0 || ( static_cast<int64_t>( mMetadata.rows.size() ) == tags_total
+			&& static_cast<int64_t>( mMetadata.schemas() ) == schemas_total
+			&& static_cast<int64_t>( mMetadata.deactivated() ) == deactivated_total ) );
+		return res;
+	}
 
-		// TODO: filter mTags and mPaths based on maxEntryTime
+	std::string PayloadAdapterDb::metadataSnapshotPath() {
+		if ( !mConfig["adapters"]["db"].contains("config") ) { return ""; }
+		return mConfig["adapters"]["db"]["config"].value( "metadata_snapshot_path", std::string() );
+	}
 
-		return true;
+	std::string PayloadAdapterDb::metadataSource() {
+		std::string servers;
+		for ( const auto& server : mConfig["adapters"]["db"][ hasAccess("get") ? "get" : "admin" ] ) {
+			servers += connectString( server ).second + "\n";
+		}
+		return picosha2::hash256_hex_string( servers );
 	}
 
 	Result<std::string> PayloadAdapterDb::createTag( const STagPtr_t& tag ) {
@@ -825,13 +1440,10 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("admin") ) {
-			res.setMsg( "cannot switch to ADMIN mode" );
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot connect to database");
+		if ( !hasAccess("admin") ) {
+			res.setMsg( "cannot switch to ADMIN mode" );
 			return res;
 		}
 
@@ -844,7 +1456,7 @@ namespace CDB {
 		}
 
 		// check for existing tag
-		if ( mPaths.find( sanitized_path ) != mPaths.end() ) {
+		if ( snapshot->paths.find( sanitized_path ) != snapshot->paths.end() ) {
 			res.setMsg( "attempt to create an existing tag " + sanitized_path );
 			return res;
 		}
@@ -864,8 +1476,8 @@ namespace CDB {
 		sanitized_path = parts.size() ? implode( parts, "/" ) : "";
 
 		if ( sanitized_path.size() ) {
-			auto ptagit = mPaths.find( sanitized_path );
-			if ( ptagit != mPaths.end() ) {
+			auto ptagit = snapshot->paths.find( sanitized_path );
+			if ( ptagit != snapshot->paths.end() ) {
 				parent_tag = (ptagit->second).get();
 				tag_pid = parent_tag->id();
 			} else {
@@ -891,13 +1503,10 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("admin") ) {
-			res.setMsg( "db adapter is not configured for writes" );
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot connect to database");
+		if ( !hasAccess("admin") ) {
+			res.setMsg( "db adapter is not configured for writes" );
 			return res;
 		}
 
@@ -910,9 +1519,9 @@ namespace CDB {
 		}
 
 		// check for existing tag
-		auto tagit = mPaths.find( sanitized_path );
+		auto tagit = snapshot->paths.find( sanitized_path );
 
-		if ( tagit == mPaths.end() ) {
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find path in the database, path: " + path );
 			return res;
 		}
@@ -924,18 +1533,22 @@ namespace CDB {
 			return res;
 		}
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
 			try {
-				mSession->once << "UPDATE cdb_tags SET dt = :dt WHERE id = :id",
+				session->once << "UPDATE cdb_tags SET dt = :dt WHERE id = :id",
 					use(deactiveTime), use(tag_id);
 			} catch ( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
 			res = tag_id;
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		return res;
 	}
@@ -949,6 +1562,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !tag_id.size() ) {
 			res.setMsg( "cannot create new tag: empty tag id provided" );
 			return res;
@@ -959,34 +1574,33 @@ namespace CDB {
 			return res;
 		}
 
-		if ( tag_pid.size() && mTags.find( tag_pid ) == mTags.end() ) {
+		if ( tag_pid.size() && snapshot->tags.find( tag_pid ) == snapshot->tags.end() ) {
 			res.setMsg( "parent tag provided but not found in the map" );
 			return res;
 		}
 
-		if ( !setAccessMode("admin") ) {
+		if ( !hasAccess("admin") ) {
 			res.setMsg( "cannot switch to ADMIN mode" );
 			return res;
 		}
 
-		if ( !ensureConnection() ) {
-			res.setMsg( "db adapter cannot ensure connection" );
-			return res;
-		}
-
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
 			// insert new tag into the database
 			try {
-				mSession->once << "INSERT INTO cdb_tags ( id, name, pid, tbname, ct, dt, mode ) VALUES ( :id, :name, :pid, :tbname, :ct, :dt, :mode ) ",
+				session->once << "INSERT INTO cdb_tags ( id, name, pid, tbname, ct, dt, mode ) VALUES ( :id, :name, :pid, :tbname, :ct, :dt, :mode ) ",
 					use(tag_id), use(tag_name), use(tag_pid), use(tag_tbname), use(tag_ct), use(tag_dt), use(tag_mode);
 			} catch ( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
 
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		// if it is a struct, create IOV + Data tables
 		if ( tag_tbname.size() ) {
@@ -997,17 +1611,10 @@ namespace CDB {
 			}
 		}
 
-		// create new tag object and set parent-child relationship
-		STagPtr_t new_tag = std::make_shared<Tag>( tag_id, tag_name, tag_pid, tag_tbname, tag_ct, tag_dt );
-		if ( tag_pid.size() ) {
-			STagPtr_t parent_tag = ( mTags.find( tag_pid ) )->second;
-			new_tag->setParent( parent_tag );
-			parent_tag->addChild( new_tag );
-		}
-
-		// add new tag to maps
-		mTags.insert({ tag_id, new_tag });
-		mPaths.insert({ new_tag->path(), new_tag });
+		// published tags are never changed, the new one comes with a fresh snapshot which links it to its parent
+		const std::lock_guard<std::mutex> lock(mMetadataMutex);
+		mMetadata.add( std::make_shared<Tag>( tag_id, tag_name, tag_pid, tag_tbname, tag_ct, tag_dt, tag_mode ) );
+		std::atomic_store( &mTagSnapshot, mMetadata.build() );
 
 		res = tag_id;
 
@@ -1021,17 +1628,15 @@ namespace CDB {
 			return tags;
 		}
 
-		if ( !setAccessMode("get") ) {
-			return tags;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
+		if ( !hasAccess("get") ) {
 			return tags;
 		}
 
-		tags.reserve( mPaths.size() );
+		tags.reserve( snapshot->paths.size() );
 
-		for ( const auto& [key, value] : mPaths ) {
+		for ( const auto& [key, value] : snapshot->paths ) {
 			if ( value->mode() == 0 ) {
 				const auto& children = value->children();
 				if ( children.size() == 0 ) {
@@ -1069,12 +1674,8 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("get") ) {
+		if ( !hasAccess("get") ) {
 			res.setMsg( "db adapter is not configured" );
-		}
-
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot ensure database connection");
 			return res;
 		}
 
@@ -1084,19 +1685,37 @@ namespace CDB {
 			return res;
 		}
 
-		std::string storage_name = tbparts[0], id = tbparts[1], data;
+		std::string storage_name = tbparts[0], id = tbparts[1], data, bytes;
+
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("get");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+			bool read_blob = blobStorage( session.dbtype() ) && hasBlobColumn( session, storage_name );
 
 			try {
-				mSession->once << ("SELECT data FROM cdb_data_" + storage_name + " WHERE id = :id"), into(data), use( id );
+				if ( read_blob ) {
+					// rows written before the migration still carry base64 in data
+					bytes = fetchBlob( session, [&]( auto& bdata, soci::indicator& ind ) {
+							session->once << ("SELECT data, bdata FROM cdb_data_" + storage_name + " WHERE id = :id"), into(data), into(bdata, ind), use( id );
+							});
+				} else {
+					session->once << ("SELECT data FROM cdb_data_" + storage_name + " WHERE id = :id"), into(data), use( id );
+				}
 			} catch( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
 
-		} // RAII scope lock for the db access mutex
+		} // RAII scope block for the pooled db session
+
+		if ( bytes.size() ) {
+			res = std::move(bytes);
+			return res;
+		}
 
 		if ( !data.size() ) {
 			res.setMsg("no data");
@@ -1115,18 +1734,15 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("get") ) {
-			res.setMsg("cannot switch to GET mode");
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot connect to the database");
+		if ( !hasAccess("get") ) {
+			res.setMsg("cannot switch to GET mode");
 			return res;
 		}
 
-		auto tagit = mPaths.find( tag_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( tag_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg("cannot find path");
 			return res;
 		}
@@ -1135,16 +1751,20 @@ namespace CDB {
 
 		std::string schema{""};
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("get");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
 			try {
-				mSession->once << "SELECT data FROM cdb_schemas WHERE pid = :pid ", into(schema), use(pid);
+				session->once << "SELECT data FROM cdb_schemas WHERE pid = :pid ", into(schema), use(pid);
 			} catch( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		if ( schema.size() ) {
 			res = schema;
@@ -1163,7 +1783,9 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !mTags.size() || !mPaths.size() ) {
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
+		if ( !snapshot->tags.size() || !snapshot->paths.size() ) {
 			res.setMsg("no tags, cannot export");
 			return res;
 		}
@@ -1182,7 +1804,7 @@ namespace CDB {
 		if ( schemas ) {
 			output["schemas"] = nlohmann::json::array();
 		}
-		for ( const auto& [ key, value ] : mPaths ) {
+		for ( const auto& [ key, value ] : snapshot->paths ) {
 			if ( tags ) {
 				output["tags"].push_back( value->toJson() );
 			}
@@ -1260,13 +1882,10 @@ namespace CDB {
 			return res;
 		}
 
-		if ( !setAccessMode("admin") ) {
-			res.setMsg("cannot set ADMIN mode");
-			return res;
-		}
+		STagSnapshotPtr_t snapshot = tagSnapshot();
 
-		if ( !ensureConnection() ) {
-			res.setMsg("cannot ensure connection");
+		if ( !hasAccess("admin") ) {
+			res.setMsg("cannot set ADMIN mode");
 			return res;
 		}
 
@@ -1279,8 +1898,8 @@ namespace CDB {
 		}
 
 		std::string tag_pid = "";
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag path in the database... path: " + sanitized_path );
 			return res;
 		}
@@ -1295,17 +1914,21 @@ namespace CDB {
 
 		std::string existing_id = "";
 
-		{ // RAII scope block for the db access schema
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
 			try {
-				mSession->once << "SELECT id FROM cdb_schemas WHERE pid = :pid ", into(existing_id), use(tag_pid);
+				session->once << "SELECT id FROM cdb_schemas WHERE pid = :pid ", into(existing_id), use(tag_pid);
 			} catch( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
 
-		} // RAII scope block for the db access schema
+		} // RAII scope block for the pooled db session
 
 		if ( existing_id.size() ) {
 			res.setMsg( "cannot set schema as it already exists for " + sanitized_path );
@@ -1344,20 +1967,24 @@ namespace CDB {
 			return res;
 		}
 
-		{ // RAII scope block for the db access mutex
-			const std::lock_guard<std::mutex> lock(cdbnpp_db_access_mutex);
+		{ // RAII scope block for the pooled db session
+			SessionLease session = leaseSession("admin");
+			if ( !session ) {
+				res.setMsg( "cannot lease database session" );
+				return res;
+			}
 
 			// insert schema into cdb_schemas table
 			try {
 				std::string schema_id = generate_uuid(), data = schema_json;
 				long long ct = 0, dt = 0;
-				mSession->once << "INSERT INTO cdb_schemas ( id, pid, data, ct, dt ) VALUES( :schema_id, :pid, :data, :ct, :dt )",
+				session->once << "INSERT INTO cdb_schemas ( id, pid, data, ct, dt ) VALUES( :schema_id, :pid, :data, :ct, :dt )",
 					use(schema_id), use(tag_pid), use(data), use(ct), use(dt);
 			} catch( std::exception const & e ) {
 				res.setMsg( "database exception: " + std::string(e.what()) );
 				return res;
 			}
-		} // RAII scope block for the db access mutex
+		} // RAII scope block for the pooled db session
 
 		res = true;
 		return res;
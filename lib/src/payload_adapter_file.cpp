@@ -1,12 +1,17 @@
 
 #include "npp/cdb/payload_adapter_file.h"
 
+#include <algorithm>
 #include <filesystem>
+#include <iterator>
 #include <fstream>
+#include <mutex>
 #include <shared_mutex>
 
+#include "npp/util/compression.h"
 #include "npp/util/json_schema.h"
 #include "npp/util/log.h"
+#include "npp/util/mmap.h"
 #include "npp/util/util.h"
 #include "npp/util/uuid.h"
 
@@ -15,7 +20,6 @@ namespace CDB {
 
 	using namespace NPP::Util;
 
-	std::shared_mutex cdbnpp_file_mutex;
   typedef std::unique_lock<std::shared_mutex>  FileWriteLock;
   typedef std::shared_lock<std::shared_mutex>  FileReadLock;
 
@@ -25,27 +29,34 @@ namespace CDB {
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
 		PayloadResults_t res;
 
-		FileReadLock lock(cdbnpp_file_mutex);
+		FileReadLock lock(mFileMutex);
 
 		std::string dir = std::filesystem::current_path().string()
 			+ "/" + config().value("dirname",".CDBNPP") + "/";
 
 		std::set<std::string> unfolded_paths{};
-		for ( const auto& path : paths ) {
-			std::vector<std::string> parts = explode( path, ":" );
-			std::string flavor = parts.size() == 2 ? parts[0] : "";
-			std::string unflavored_path = parts.size() == 2 ? parts[1] : parts[0];
-			if ( !std::filesystem::is_directory( dir + unflavored_path ) ) {
-				for ( auto const& dir_entry : std::filesystem::recursive_directory_iterator( dir ) ) {
-					if ( !dir_entry.is_directory() ) { continue; }
-					if ( string_starts_with( dir_entry.path().string(), dir + unflavored_path ) ) {
-						unfolded_paths.insert( ( flavor.size() ? (flavor + ":") : "" ) + dir_entry.path().string().substr( dir.size() ) );
-					}
+		{ // RAII scope block for the directory index
+			const std::lock_guard<std::mutex> index_lock(mIndexMutex);
+			const std::set<std::string>& index = structIndex( dir );
+			for ( const auto& path : paths ) {
+				std::vector<std::string> parts = explode( path, ":" );
+				std::string flavor = parts.size() == 2 ? parts[0] : "";
+				std::string unflavored_path = parts.size() == 2 ? parts[1] : parts[0];
+				if ( index.count( unflavored_path ) ) {
+					unfolded_paths.insert( path );
+					continue;
+				}
+				// directory => structs below it, otherwise a plain prefix
+				std::string prefix = unflavored_path;
+				if ( prefix.size() && prefix.back() != '/' && std::filesystem::is_directory( dir + prefix ) ) {
+					prefix += "/";
+				}
+				auto [ first, last ] = container_prefix_range( index, prefix );
+				for ( auto it = first; it != last; ++it ) {
+					unfolded_paths.insert( ( flavor.size() ? (flavor + ":") : "" ) + *it );
 				}
-			} else {
-				unfolded_paths.insert( path );
 			}
-		}
+		} // RAII scope block for the directory index
 
 		for ( const auto& path : unfolded_paths ) {
 			Result<SPayloadPtr_t> rc = getPayload( path, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
@@ -62,7 +73,7 @@ namespace CDB {
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t eventRun, int64_t eventSeq ) {
 		Result<SPayloadPtr_t> res;
 
-		FileReadLock lock(cdbnpp_file_mutex);
+		FileReadLock lock(mFileMutex);
 
 		auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
 
@@ -183,7 +194,7 @@ namespace CDB {
 			res.setMsg( "payload contains both beginTime and run, NOTE: api will use beginTime for payload::get");
 		}
 
-		FileWriteLock lock(cdbnpp_file_mutex);
+		FileWriteLock lock(mFileMutex);
 
 		std::string path = std::filesystem::current_path().string()
 			+ "/"	+ config().value("dirname",".CDBNPP") + "/";
@@ -218,13 +229,14 @@ namespace CDB {
 				res.setMsg( "cannot create directory = " + path );
 				return res; // cannot create directory
 			}
+			invalidateIndex();
 		}
 
 		// initialize create time if not set
 		if ( payload->createTime() == 0 ) { payload->setCreateTime( time(NULL) ); }
 
 		// construct full file name
-		// format: <structName>.<flavor>.c<time>_b<time>_e<time>_d<time>.dat
+		// format: <structName>.<flavor>.c<time>_b<time>_e<time>_d<time>.dat[.zst|.lz4]
 
 		std::string filename = path
 			+ "/"	+ sanitize_alnum( payload->flavor() ) + ".";
@@ -257,15 +269,27 @@ namespace CDB {
 
 		filename += implode( chunks, "_" );
 		filename += "." + payload->format();
+		if ( payload->codec().size() ) {
+			filename += "." + codec_file_extension( payload->codec() ); // i.e. .json.zst
+		}
 
-		// store payload contents to disk
-		std::ofstream ofs( filename );
+		// store payload contents to disk: written aside, then renamed over, so that a file is never truncated
+		// under a reader which has it mapped; the hidden temporary name does not decode as a payload
+		std::string tmpname = path + "/." + std::filesystem::path( filename ).filename().string() + ".tmp";
+		std::ofstream ofs( tmpname, std::ios::binary );
 		if ( !ofs.is_open() ) {
-			res.setMsg( "file cannot be opened = " + filename );
+			res.setMsg( "file cannot be opened = " + tmpname );
 			return res;
 		}
-		ofs << payload->data();
+		ofs << payload->storedData();
 		ofs.close();
+		std::error_code ec;
+		std::filesystem::rename( tmpname, filename, ec );
+		if ( ec ) {
+			std::filesystem::remove( tmpname, ec );
+			res.setMsg( "file cannot be stored = " + filename );
+			return res;
+		}
 
 		res = payload->id();
 		return res;
@@ -307,11 +331,12 @@ namespace CDB {
 
 		std::string complete_path = root_path + "/" + directory + "/" + structName;
 		if ( !std::filesystem::exists( complete_path ) ) {
-			FileReadLock lock(cdbnpp_file_mutex);
+			FileReadLock lock(mFileMutex);
 			if ( !std::filesystem::create_directories( complete_path ) ) {
 				res.setMsg( "cannot create directory = " + complete_path );
 				return res;
 			}
+			invalidateIndex();
 		}
 
 		SPayloadPtr_t p = std::make_shared<Payload>();
@@ -336,7 +361,7 @@ namespace CDB {
 	Result<std::string> PayloadAdapterFile::createTag( const std::string& path, __attribute__ ((unused)) int64_t tag_mode ) {
 		Result<std::string> res;
 
-		FileWriteLock lock(cdbnpp_file_mutex);
+		FileWriteLock lock(mFileMutex);
 
 		std::string sanitized_path = path;
 		trim( sanitized_path );
@@ -359,6 +384,7 @@ namespace CDB {
 			res.setMsg( "cannot create directory = " + new_path );
 			return res;
 		}
+		invalidateIndex();
 		res = uuid_from_str( sanitized_path );
 		return res;
 	}
@@ -386,6 +412,77 @@ namespace CDB {
 		return res;
 	}
 
+	Result<SharedBuffer> PayloadAdapterFile::mapData( const std::string& uri ) {
+		Result<SharedBuffer> res;
+		if ( !uri.size() ) {
+			res.setMsg( "empty uri" );
+			return res;
+		}
+
+		auto parts = explode( uri, "://" );
+		if ( parts.size() != 2 || parts[0] != "file" ) {
+			res.setMsg( "bad uri: " + uri );
+			return res;
+		}
+
+		// small files are cheaper to read than to map, a mapping costs at least a page and a syscall pair
+		size_t mmap_min_size = 65536;
+		if ( mConfig.contains("adapters") && mConfig["adapters"].contains("file") ) {
+			mmap_min_size = mConfig["adapters"]["file"].value( "mmap_min_size", mmap_min_size );
+		}
+
+		std::error_code ec;
+		size_t size = std::filesystem::file_size( parts[1], ec );
+		if ( ec ) {
+			res.setMsg( "cannot stat " + parts[1] + ": " + ec.message() );
+			return res;
+		}
+		if ( size < mmap_min_size ) {
+			res = SharedBuffer( file_get_contents( parts[1] ) );
+			return res;
+		}
+
+		return MappedFile::buffer( parts[1] );
+	}
+
+	const std::set<std::string>& PayloadAdapterFile::structIndex( const std::string& root ) {
+		int64_t ttl_seconds = 60;
+		if ( mConfig.contains("adapters") && mConfig["adapters"].contains("file") ) {
+			ttl_seconds = mConfig["adapters"]["file"].value( "index_ttl_seconds", ttl_seconds );
+		}
+		uint64_t generation = mIndexGeneration;
+		if ( mIndexBuiltGeneration == generation && mIndexRoot == root && std::chrono::steady_clock::now() - mIndexBuilt < std::chrono::seconds( ttl_seconds ) ) {
+			return mStructIndex;
+		}
+
+		// one walk over the store: every directory which is nobody's parent is a struct
+		std::set<std::string> dirs{}, parents{};
+		std::error_code ec;
+		for ( auto it = std::filesystem::recursive_directory_iterator( root, ec ); !ec && it != std::filesystem::recursive_directory_iterator(); it.increment( ec ) ) {
+			if ( !it->is_directory( ec ) ) { continue; }
+			std::string rel = it->path().string().substr( root.size() );
+			if ( rel.size() && rel[0] == '.' ) {
+				it.disable_recursion_pending(); // .schemas and friends
+				continue;
+			}
+			dirs.insert( rel );
+			size_t pos = rel.rfind( '/' );
+			if ( pos != std::string::npos ) {
+				parents.insert( rel.substr( 0, pos ) );
+			}
+		}
+		if ( ec ) {
+			CDBNPP_LOG_ERROR << "cannot index " << root << ": " << ec.message() << std::endl;
+		}
+
+		mStructIndex.clear();
+		std::set_difference( dirs.begin(), dirs.end(), parents.begin(), parents.end(), std::inserter( mStructIndex, mStructIndex.end() ) );
+		mIndexRoot = root;
+		mIndexBuilt = std::chrono::steady_clock::now();
+		mIndexBuiltGeneration = generation; // directories created during the walk bump it again
+		return mStructIndex;
+	}
+
 	DecodedFileNameTuple PayloadAdapterFile::decodeFilename( const std::string& filename ) {
 		// file format: <flavor>.c<datetime>_b<datetime>_e<datetime>_d<datetime>_r<runnumber>.dat
 		std::string flavor;
@@ -447,7 +544,7 @@ namespace CDB {
 	Result<std::string> PayloadAdapterFile::getTagSchema( const std::string& tag_path ) {
 		Result<std::string> res;
 
-		FileReadLock lock(cdbnpp_file_mutex);
+		FileReadLock lock(mFileMutex);
 
 		std::string schema_path = std::filesystem::current_path().string()
 			+ "/" + config().value("dirname",".CDBNPP") + "/.schemas";
@@ -472,7 +569,7 @@ namespace CDB {
 	Result<bool> PayloadAdapterFile::setTagSchema( const std::string& tag_path, const std::string& schema_json ) {
 		Result<bool> res;
 
-		FileWriteLock lock(cdbnpp_file_mutex);
+		FileWriteLock lock(mFileMutex);
 
 		std::string schema_path = std::filesystem::current_path().string()
 			+ "/" + config().value("dirname",".CDBNPP") + "/.schemas";
@@ -503,7 +600,7 @@ namespace CDB {
 	Result<bool> PayloadAdapterFile::dropTagSchema( const std::string& tag_path ) {
 		Result<bool> res;
 
-		FileWriteLock lock(cdbnpp_file_mutex);
+		FileWriteLock lock(mFileMutex);
 
 		std::string schema_path = std::filesystem::current_path().string()
 			+ "/" + config().value("dirname",".CDBNPP") + "/.schemas";
@@ -550,7 +647,7 @@ namespace CDB {
 		std::string root_path = std::filesystem::current_path().string() + "/" + config().value("dirname",".CDBNPP"),
 			schema_path = root_path + "/.schemas";
 
-		FileWriteLock lock(cdbnpp_file_mutex);
+		FileWriteLock lock(mFileMutex);
 
 		if ( data.contains("tags") ) {
 			for ( const auto& [ key, tag ] : data["tags"].items() ) {
@@ -562,6 +659,7 @@ namespace CDB {
 					std::filesystem::create_directories( root_path + "/" + tag_path );
 				}
 			}
+			invalidateIndex();
 		}
 
 		if ( data.contains("schemas") ) {
@@ -1,6 +1,7 @@
 
 #include "npp/cdb/payload_adapter_http.h"
 
+#include <algorithm>
 #include <mutex>
 
 #include "npp/util/base64.h"
@@ -14,36 +15,65 @@ namespace CDB {
 
 	using namespace NPP::Util;
 
-	std::mutex cdbnpp_http_metadata_mutex;  // protects mTags, mPaths
-
 	PayloadAdapterHttp::PayloadAdapterHttp() : IPayloadAdapter("http"), mHttpClient(new HttpClient) {}
 
 	PayloadResults_t PayloadAdapterHttp::getPayloads( const std::set<std::string>& paths, const std::vector<std::string>& flavors,
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
-		// TODO: possible latency optimization: do bulk HTTP request here instead of many single requests
-
 		PayloadResults_t res;
 
 		if ( !ensureMetadata() ) {
 			return res;
 		}
 
+		// tags and paths stay as they are for the whole lookup, even if a refresh swaps in new ones meanwhile
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		std::set<std::string> unfolded_paths{};
 		for ( const auto& path : paths ) {
 			std::vector<std::string> parts = explode( path, ":" );
 			std::string flavor = parts.size() == 2 ? parts[0] : "";
 			std::string unflavored_path = parts.size() == 2 ? parts[1] : parts[0];
-			if ( mPaths.count(unflavored_path) == 0 ) {
-				for ( const auto& [ key, value ] : mPaths ) {
-					if ( string_starts_with( key, unflavored_path ) && value->mode() > 0 ) {
-						unfolded_paths.insert( ( flavor.size() ? ( flavor + ":" ) : "" ) + key );
-					}
-				}
-			} else {
+			auto tagit = snapshot->paths.find( unflavored_path );
+			if ( tagit != snapshot->paths.end() && tagit->second->mode() > 0 ) {
 				unfolded_paths.insert( path );
+				continue;
+			}
+			// directory tag => structs below it, otherwise a plain prefix; paths are sorted, so matches are adjacent
+			std::string prefix = tagit != snapshot->paths.end() ? unflavored_path + "/" : unflavored_path;
+			auto [ first, last ] = container_prefix_range( snapshot->paths, prefix );
+			for ( auto it = first; it != last; ++it ) {
+				if ( it->second->mode() > 0 ) {
+					unfolded_paths.insert( ( flavor.size() ? ( flavor + ":" ) : "" ) + it->first );
+				}
 			}
 		}
 
+		// pinned lookups go out as cacheable GET urls, which a squid or the local response cache can answer; the
+		// bulk POST would bypass both. The GETs share one multi handle, so a miss costs about one round trip
+		// more than bulk, a hit costs none. Bulk is kept for lookups of the latest payloads, which no cache keeps
+		auto pinned = [&]( const std::string& path ) {
+			const std::string dirpath = explode( path, ":" ).back();
+			int64_t mt = maxEntryTime;
+			for ( const auto& [ opath, otime ] : maxEntryTimeOverrides ) {
+				if ( string_starts_with( dirpath, opath ) ) {
+					mt = otime;
+					break;
+				}
+			}
+			return pinnedMaxEntryTime( mt );
+		};
+		if ( bulkGet() && !mBulkUnsupported && !std::all_of( unfolded_paths.begin(), unfolded_paths.end(), pinned ) ) {
+			Result<PayloadResults_t> rc = getPayloadsBulk( *snapshot, unfolded_paths, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
+			if ( rc.valid() ) {
+				return rc.get();
+			}
+			CDBNPP_LOG_ERROR << "bulk payload get failed, falling back to per-path requests: " << rc.msg() << std::endl;
+		}
+
+		if ( unfolded_paths.size() > 1 ) {
+			return getPayloadsConcurrent( *snapshot, unfolded_paths, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
+		}
+
 		for ( const auto& path : unfolded_paths ) {
 			Result<SPayloadPtr_t> rc = getPayload( path, flavors, maxEntryTimeOverrides, maxEntryTime, eventTime, run, seq );
 			if ( rc.valid() ) {
@@ -54,6 +84,223 @@ namespace CDB {
 		return res;
 	}
 
+	PayloadResults_t PayloadAdapterHttp::getPayloadsConcurrent( const TagSnapshot& snapshot, const std::set<std::string>& paths, const std::vector<std::string>& service_flavors,
+			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
+		PayloadResults_t res;
+
+		// all flavors are requested at once, the most preferred one found wins
+		struct Request {
+			size_t item{0}, flavorIdx{0};
+		};
+		struct Item {
+			std::string directory, structName, tbname;
+			size_t flavorIdx{0};
+			SPayloadPtr_t payload{nullptr};
+		};
+		std::vector<Item> items;
+		std::vector<Request> requests;
+		std::vector<std::string> queries; // relative to the server url
+
+		for ( const auto& path : paths ) {
+			auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
+			const std::vector<std::string>& lookup_flavors = flavors.size() ? flavors : service_flavors;
+			if ( !is_path_valid || !directory.size() || !structName.size() || !lookup_flavors.size() ) { continue; }
+
+			std::string dirpath = directory + "/" + structName;
+			auto tagit = snapshot.paths.find( dirpath );
+			if ( tagit == snapshot.paths.end() || !tagit->second->tbname().size() ) { continue; }
+
+			int64_t mt = maxEntryTime;
+			// check for path-specific maxEntryTime overrides
+			for ( const auto& [ opath, otime ] : maxEntryTimeOverrides ) {
+				if ( string_starts_with( dirpath, opath ) ) {
+					mt = otime;
+					break;
+				}
+			}
+
+			items.push_back({ directory, structName, tagit->second->tbname() });
+			for ( size_t fidx = 0; fidx < lookup_flavors.size(); ++fidx ) {
+				requests.push_back({ items.size() - 1, fidx });
+				queries.push_back( "/payload_get/"
+					+ payloadGetParams( tagit->second->tbname(), lookup_flavors[fidx], tagit->second->mode(), mt, eventTime, run, seq ) );
+			}
+		}
+
+		if ( requests.empty() ) {
+			return res;
+		}
+
+		// requests which failed for transient reasons move on to the next server
+		std::vector<size_t> pending( requests.size() );
+		for ( size_t i = 0; i < pending.size(); ++i ) { pending[i] = i; }
+		forEachServer( "get", [&]( size_t idx, const std::string& base_url ) {
+			std::vector<std::string> urls;
+			for ( size_t i : pending ) {
+				urls.push_back( base_url + queries[i] );
+			}
+
+			std::vector<HttpResponse> replies = mHttpClient->GetMany( urls, [this, idx]( const std::string& ) { return generateJWT( "get", idx ); } );
+			std::vector<size_t> failed;
+			for ( size_t j = 0; j < replies.size(); ++j ) {
+				size_t i = pending[j];
+				if ( replies[j].error && HttpRetryPolicy::isRetryable( static_cast<CURLcode>( replies[j].error ), replies[j].status_code ) ) {
+					failed.push_back( i );
+					continue;
+				}
+				// no payload for a flavor comes back as an error reply
+				if ( replies[j].error ) { continue; }
+				Item& item = items[ requests[i].item ];
+				if ( item.payload && item.flavorIdx <= requests[i].flavorIdx ) { continue; }
+
+				nlohmann::json reply = nlohmann::json::parse( replies[j].text.begin(), replies[j].text.end(), nullptr, false, true );
+				if ( reply.is_discarded() || !reply.is_object() || !reply.contains("payload") ) { continue; }
+				try {
+					item.payload = payloadFromReply( reply["payload"], item.structName, item.directory, item.tbname, idx );
+					item.flavorIdx = requests[i].flavorIdx;
+				} catch( nlohmann::json::exception& e ) {
+					CDBNPP_LOG_ERROR << "server replied with malformed payload: " << e.what() << std::endl;
+				}
+			}
+
+			// a server which answered anything at all is alive
+			double elapsed = 0;
+			for ( const auto& reply : replies ) {
+				elapsed += reply.elapsed;
+			}
+			loadBalancer( "get" )->record( idx, elapsed * 1e6 / replies.size(), failed.size() != pending.size() );
+			if ( failed.size() == pending.size() ) {
+				circuitBreaker( base_url )->recordFailure();
+			} else {
+				circuitBreaker( base_url )->recordSuccess();
+			}
+			pending = std::move(failed);
+			return pending.empty();
+		});
+
+		for ( const auto& item : items ) {
+			if ( item.payload ) {
+				res.insert({ item.directory + "/" + item.structName, item.payload });
+			}
+		}
+		return res;
+	}
+
+	std::string PayloadAdapterHttp::payloadGetParams( const std::string& tbname, const std::string& flavor, int64_t mode, int64_t maxEntryTime,
+			int64_t eventTime, int64_t run, int64_t seq ) {
+		std::string params = "?";
+		params += "tb=" + tbname + "&f=" + flavor + "&mt=" + std::to_string(maxEntryTime);
+		if ( mode == 1 ) {
+			params += "&et=" + std::to_string(eventTime);
+		} else if ( mode == 2 ) {
+			params += "&run=" + std::to_string(run) + "&seq=" + std::to_string(seq);
+		}
+		if ( !pinnedMaxEntryTime( maxEntryTime ) ) {
+			// latest payloads may change any moment, keep caches out of the way
+			params += "&tm=" + std::to_string(std::time(nullptr));
+		}
+		return params;
+	}
+
+	Result<PayloadResults_t> PayloadAdapterHttp::getPayloadsBulk( const TagSnapshot& snapshot, const std::set<std::string>& paths, const std::vector<std::string>& service_flavors,
+			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
+		Result<PayloadResults_t> res;
+
+		// one request per struct, flavors in order of preference
+		struct BulkItem {
+			std::string directory, structName, tbname;
+		};
+		std::vector<BulkItem> items;
+		nlohmann::json requests = nlohmann::json::array();
+		for ( const auto& path : paths ) {
+			auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
+			const std::vector<std::string>& lookup_flavors = flavors.size() ? flavors : service_flavors;
+			if ( !is_path_valid || !directory.size() || !structName.size() || !lookup_flavors.size() ) { continue; }
+
+			std::string dirpath = directory + "/" + structName;
+			auto tagit = snapshot.paths.find( dirpath );
+			if ( tagit == snapshot.paths.end() || !tagit->second->tbname().size() ) { continue; }
+
+			int64_t mt = maxEntryTime;
+			// check for path-specific maxEntryTime overrides
+			for ( const auto& [ opath, otime ] : maxEntryTimeOverrides ) {
+				if ( string_starts_with( dirpath, opath ) ) {
+					mt = otime;
+					break;
+				}
+			}
+
+			requests.push_back({ { "tb", tagit->second->tbname() }, { "f", lookup_flavors }, { "mt", mt }, { "mode", tagit->second->mode() } });
+			items.push_back({ directory, structName, tagit->second->tbname() });
+		}
+
+		if ( !items.size() ) {
+			res = PayloadResults_t{};
+			return res;
+		}
+
+		nlohmann::json body = { { "et", eventTime }, { "run", run }, { "seq", seq }, { "requests", requests } };
+		HttpResponse r = makePostRequest( "get", "/payloads_get/", { { "requests", body.dump() } }, true );
+		if ( r.status_code == 404 || r.status_code == 405 ) {
+			mBulkUnsupported = true;
+		}
+		if ( r.error ) {
+			res.setMsg( "bulk payload get via http(s) failed. Url: " + r.url + ", error: " + std::to_string(r.error) );
+			return res;
+		}
+
+		nlohmann::json reply = nlohmann::json::parse( r.text.begin(), r.text.end(), nullptr, false, true );
+		if ( reply.is_discarded() || !reply.is_object() || !reply.contains("payloads") || !reply["payloads"].is_array() ) {
+			res.setMsg( "server replied with malformed data (not json)" );
+			return res;
+		}
+
+		PayloadResults_t payloads;
+		size_t server = serverIndex( "get", r.url );
+		try {
+			for ( const auto& item : reply["payloads"] ) {
+				size_t idx = item.at("idx").get<size_t>();
+				if ( idx >= items.size() ) { continue; }
+				SPayloadPtr_t p = payloadFromReply( item, items[idx].structName, items[idx].directory, items[idx].tbname, server );
+				payloads.insert({ p->directory() + "/" + p->structName(), p });
+			}
+		} catch( nlohmann::json::exception& e ) {
+			res.setMsg( "server replied with malformed payload: " + std::string( e.what() ) );
+			return res;
+		}
+
+		res = payloads;
+		return res;
+	}
+
+	SPayloadPtr_t PayloadAdapterHttp::payloadFromReply( const nlohmann::json& item, const std::string& structName, const std::string& directory,
+			const std::string& tbname, size_t server ) {
+		auto p = std::make_shared<Payload>(
+				item["id"].get<std::string>(), item["pid"].get<std::string>(),
+				item["flavor"].get<std::string>(),
+				structName, directory,
+				item["ct"],  item["bt"],
+				item["et"],  item["dt"],
+				item["run"], item["seq"]
+				);
+		std::string fmt = item.contains("fmt") && item["fmt"].is_string() ? item["fmt"].get<std::string>() : "";
+		p->setURI( item["uri"], fmt );
+
+		if ( string_starts_with( p->URI(), "db://" ) ) {
+			// rewrite URI endpoint to HTTP if data is receved via HTTP adapter, data comes from the server which answered
+			std::string uri = mConfig["adapters"]["http"]["get"][server]["url"].get<std::string>() + "/download/?tbname=" + tbname + "&id=" + p->id();
+			p->setURI( uri, p->storedFormat() );
+		}
+		return p;
+	}
+
+	bool PayloadAdapterHttp::bulkGet() {
+		if ( mConfig["adapters"]["http"].contains("config") && mConfig["adapters"]["http"]["config"].contains("bulk_get") ) {
+			return mConfig["adapters"]["http"]["config"]["bulk_get"].get<bool>();
+		}
+		return true;
+	}
+
 	Result<SPayloadPtr_t> PayloadAdapterHttp::getPayload( const std::string& path, const std::vector<std::string>& service_flavors,
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
 		Result<SPayloadPtr_t> res;
@@ -63,6 +310,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
 
 		if ( !is_path_valid ) {
@@ -97,8 +346,8 @@ namespace CDB {
 		}
 
 		// get tag
-		auto tagit = mPaths.find( dirpath );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( dirpath );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag for " + dirpath );
 			return res;
 		}
@@ -113,16 +362,7 @@ namespace CDB {
 		}
 
 		for ( const auto& flavor : ( flavors.size() ? flavors : service_flavors ) ) {
-			std::string params = "?";
-			params += "tb=" + tbname + "&f=" + flavor + "&mt=" + std::to_string(maxEntryTime);
-			if ( mode == 1 ) {
-				params += "&et=" + std::to_string(eventTime);
-			} else if ( mode == 2 ) {
-				params += "&run=" + std::to_string(run) + "&seq=" + std::to_string(seq);
-			}
-			params += "&tm=" + std::to_string(std::time(nullptr)); // NOTE: limits caching
-
-			HttpResponse r = makeGetRequest( "admin", "/payload_get/" + params );
+			HttpResponse r = makeGetRequest( "get", "/payload_get/" + payloadGetParams( tbname, flavor, mode, maxEntryTime, eventTime, run, seq ) );
 			if ( r.error ) {
 				res.setMsg( "payload get via http(s) failed. Url: " + r.url + ", error: " + std::to_string(r.error) );
 				return res;
@@ -136,24 +376,7 @@ namespace CDB {
 			}
 
 			// got data from server, assemble Payload
-			auto p = std::make_shared<Payload>(
-					reply["payload"]["id"].get<std::string>(), reply["payload"]["pid"].get<std::string>(),
-					reply["payload"]["flavor"].get<std::string>(),
-					structName, directory,
-					reply["payload"]["ct"],  reply["payload"]["bt"],
-					reply["payload"]["et"],  reply["payload"]["dt"],
-					reply["payload"]["run"], reply["payload"]["seq"]
-					);
-			p->setData( std::string(""), reply["payload"]["fmt"] );
-			p->setURI( reply["payload"]["uri"] );
-
-			if ( string_starts_with( p->URI(), "db://" ) ) {
-				// rewrite URI endpoint to HTTP if data is receved via HTTP adapter
-				std::string uri = mConfig["adapters"]["http"]["get"][0]["url"].get<std::string>() + "/download/?tbname=" + tbname + "&id=" + p->id();
-				p->setURI( uri );
-			}
-
-			res = p;
+			res = payloadFromReply( reply["payload"], structName, directory, tbname, serverIndex( "get", r.url ) );
 			return res;
 		} // loop over flavors
 
@@ -173,14 +396,16 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("set") ) {
 			res.setMsg( "http adapter is not configured" );
 			return res;
 		}
 
 		// get tag, fetch tbname
-		auto tagit = mPaths.find( payload->directory() + "/" + payload->structName() );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( payload->directory() + "/" + payload->structName() );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find payload tag in the database: " + payload->directory() + "/" + payload->structName() );
 			return res;
 		}
@@ -202,23 +427,38 @@ namespace CDB {
 		std::string tbname = tagit->second->tbname();
 		sanitize_alnumuscore(tbname);
 
-		HttpPostParams_t params{};
-		params.push_back({ "id", payload->id() });
-		params.push_back({ "pid", payload->pid() });
-		params.push_back({ "flavor", payload->flavor() });
-		params.push_back({ "ct", std::to_string(std::time(nullptr)) });
-		params.push_back({ "dt", std::to_string(payload->deactiveTime()) });
-		params.push_back({ "bt", std::to_string(payload->beginTime()) });
-		params.push_back({ "et", std::to_string(payload->endTime()) });
-		params.push_back({ "run", std::to_string(payload->run()) });
-		params.push_back({ "seq", std::to_string(payload->seq()) });
-		params.push_back({ "fmt", payload->format() });
-		params.push_back({ "uri", payload->URI() });
-		params.push_back({ "tbname", tbname });
-		params.push_back({ "data", payload->data() });
-		params.push_back({ "data_size", std::to_string( payload->data().size() ) });
-
-		HttpResponse r = makePostRequest( "admin", "/payload_set/", params );
+		// compressed data travels as is, i.e. "json+zstd", unless the server is known to turn it down
+		auto upload = [&]( bool compressed ) {
+			HttpPostParams_t params{};
+			params.push_back({ "id", payload->id() });
+			params.push_back({ "pid", payload->pid() });
+			params.push_back({ "flavor", payload->flavor() });
+			params.push_back({ "ct", std::to_string(std::time(nullptr)) });
+			params.push_back({ "dt", std::to_string(payload->deactiveTime()) });
+			params.push_back({ "bt", std::to_string(payload->beginTime()) });
+			params.push_back({ "et", std::to_string(payload->endTime()) });
+			params.push_back({ "run", std::to_string(payload->run()) });
+			params.push_back({ "seq", std::to_string(payload->seq()) });
+			params.push_back({ "fmt", compressed ? payload->storedFormat() : payload->format() });
+			params.push_back({ "uri", payload->URI() });
+			params.push_back({ "tbname", tbname });
+			std::string_view data = compressed ? payload->storedData() : payload->dataView();
+			params.push_back({ "data", std::string( data ) });
+			params.push_back({ "data_size", std::to_string( data.size() ) });
+			return makePostRequest( "admin", "/payload_set/", params );
+		};
+
+		bool compressed = payload->codec().size() && !mCompressedUnsupported;
+		HttpResponse r = upload( compressed );
+		if ( r.error && r.status_code == 400 && compressed ) {
+			// only servers on mysql have a binary column for compressed data, the others reject it before storing
+			// anything, so the upload is safe to repeat uncompressed
+			r = upload( false );
+			if ( !r.error ) {
+				mCompressedUnsupported = true;
+				CDBNPP_LOG_INFO << "WARNING: http server does not store compressed payloads, uploading them uncompressed" << std::endl;
+			}
+		}
 		if ( r.error ) {
 			res.setMsg( "payload set via http(s) failed. Url: " + r.url + ", text: " + r.text + ", error: " + std::to_string(r.error) );
 			return res;
@@ -241,6 +481,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("admin") ) {
 			res.setMsg( "http adapter is not configured" );
 			return res;
@@ -255,8 +497,8 @@ namespace CDB {
 		}
 
 		// get tag, fetch tbname
-		auto tagit = mPaths.find( payload->directory() + "/" + payload->structName() );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( payload->directory() + "/" + payload->structName() );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find payload tag in the database: " + payload->directory() + "/" + payload->structName() );
 			return res;
 		}
@@ -287,6 +529,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
 
 		if ( !flavors.size() ) {
@@ -300,8 +544,8 @@ namespace CDB {
 		}
 
 		// see if path exists in the known tags map
-		auto tagit = mPaths.find( directory + "/" + structName );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( directory + "/" + structName );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "path does not exist in the db. path: " + directory + "/" + structName );
 			return res;
 		}
@@ -368,6 +612,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("admin") ) {
 			res.setMsg( "http adapter is not configured" );
 			return res;
@@ -382,8 +628,8 @@ namespace CDB {
 		}
 
 		// check for existing tag
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit != mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit != snapshot->paths.end() ) {
 			res.setMsg( "attempt to create an existing tag " + sanitized_path );
 			return res;
 		}
@@ -403,8 +649,8 @@ namespace CDB {
 		sanitized_path = parts.size() ? implode( parts, "/" ) : "";
 
 		if ( sanitized_path.size() ) {
-			auto ptagit = mPaths.find( sanitized_path );
-			if ( ptagit != mPaths.end() ) {
+			auto ptagit = snapshot->paths.find( sanitized_path );
+			if ( ptagit != snapshot->paths.end() ) {
 				parent_tag = (ptagit->second).get();
 				tag_pid = parent_tag->id();
 			} else {
@@ -452,6 +698,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("admin") ) {
 			res.setMsg( "http adapter is not configured" );
 			return res;
@@ -466,8 +714,8 @@ namespace CDB {
 		}
 
 		// check for existing tag
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "attempt to create an existing tag " + sanitized_path );
 			return res;
 		}
@@ -499,64 +747,125 @@ namespace CDB {
 			return false;
 		}
 
-		const std::lock_guard<std::mutex> lock(cdbnpp_http_metadata_mutex);
+		const std::lock_guard<std::mutex> lock(mMetadataMutex);
 		if ( mMetadataAvailable ) { return true; }
 
-		mMetadataAvailable = false;
-		mTags.clear();
-		mPaths.clear();
+		// warm start: only the changes since the snapshot was taken have to come from the server
+		std::string snapshot = metadataSnapshotPath();
+		if ( snapshot.size() ) {
+			mMetadata.load( snapshot, metadataSource() );
+		}
 
-		HttpResponse r = makeGetRequest( "get", "/tags/" );
-		if ( r.error ) {
-			// download of metadata via http(s) failed :(
+		if ( !syncMetadata( false ) ) {
 			return false;
 		}
 
-		nlohmann::json meta = nlohmann::json::parse( r.text.begin(), r.text.end(), nullptr, false, true );
-		if ( meta.empty() || meta.is_discarded() || !meta.contains("tags") ) {
+		mMetadataAvailable = true;
+
+		return true;
+	}
+
+	bool PayloadAdapterHttp::refreshMetadata( bool full ) {
+		if ( !hasAccess("get") ) {
 			return false;
 		}
 
-		for ( auto it : meta["tags"] ) {
-			mTags.insert({ it["id"], std::make_shared<Tag>( it["id"], it["name"], it["pid"], it["tbname"], it["ct"], it["dt"], it["mode"], it["schema_id"].is_null() ? "" : it["schema_id"] ) });
+		const std::lock_guard<std::mutex> lock(mMetadataMutex);
+		if ( !mMetadataAvailable && !full ) {
+			std::string snapshot = metadataSnapshotPath();
+			if ( snapshot.size() ) {
+				mMetadata.load( snapshot, metadataSource() );
+			}
+		}
+		if ( !syncMetadata( full ) ) {
+			return false;
 		}
+		mMetadataAvailable = true;
+		return true;
+	}
 
-		if ( mTags.size() ) {
-			// erase tags that have parent id but no parent exists => side-effect of tag deactivation and/or maxEntryTime
-			// unfortunately, std::erase_if is C++20
-			container_erase_if( mTags, [this]( const auto item ) {
-					return ( item.second->pid().size() && mTags.find( item.second->pid() ) == mTags.end() );
-					});
+	bool PayloadAdapterHttp::syncMetadata( bool full ) {
+		if ( full ) {
+			mMetadata.clear();
 		}
 
-		// parent-child: assign children and parents
-		if ( mTags.size() ) {
-			for ( auto& tag : mTags ) {
-				if ( !(tag.second)->pid().size() ) { continue; }
-				auto rc = mTags.find( ( tag.second )->pid() );
-				if ( rc == mTags.end() ) { continue; }
-				( tag.second )->setParent( rc->second );
-				( rc->second )->addChild( tag.second );
-			}
-			// populate lookup map: path => Tag obj
-			for ( const auto& tag : mTags ) {
-				mPaths.insert({ ( tag.second )->path(), tag.second });
+		int64_t since = mMetadata.rows.size() ? mMetadata.synced : 0;
+		Result<bool> rc = fetchMetadata( since );
+		if ( rc.invalid() ) {
+			CDBNPP_LOG_ERROR << "metadata download failed: " << rc.msg() << std::endl;
+			return false;
+		}
+		if ( !rc.get() ) {
+			// delta does not add up: tags imported with old timestamps or schemas dropped, start over
+			mMetadata.clear();
+			rc = fetchMetadata( 0 );
+			if ( rc.invalid() ) {
+				CDBNPP_LOG_ERROR << "metadata download failed: " << rc.msg() << std::endl;
+				return false;
 			}
 		}
 
-		mMetadataAvailable = true;
+		// lookups still running keep the snapshot they started with, new ones pick this one up
+		std::atomic_store( &mTagSnapshot, mMetadata.build() );
 
+		std::string snapshot = metadataSnapshotPath();
+		if ( snapshot.size() && !mMetadata.save( snapshot, metadataSource() ) ) {
+			CDBNPP_LOG_ERROR << "cannot write metadata snapshot " << snapshot << std::endl;
+		}
 		return true;
 	}
 
+	Result<bool> PayloadAdapterHttp::fetchMetadata( int64_t since ) {
+		Result<bool> res;
+
+		HttpResponse r = makeGetRequest( "get", since > 0 ? "/tags/?since=" + std::to_string( since ) : "/tags/" );
+		if ( r.error ) {
+			res.setMsg( "metadata get via http(s) failed. Url: " + r.url + ", error: " + std::to_string(r.error) );
+			return res;
+		}
+
+		nlohmann::json meta = nlohmann::json::parse( r.text.begin(), r.text.end(), nullptr, false, true );
+		if ( meta.empty() || meta.is_discarded() || !meta.contains("tags") ) {
+			res.setMsg( "malformed metadata reply" );
+			return res;
+		}
+
+		mMetadata.merge( meta["tags"] );
+
+		// timestamps only tell about new and deactivated tags, counts catch what slipped through, i.e. a deactivation
+		// dated before the last sync; servers without delta support send everything and no counts
+		if ( since == 0 || !meta.contains("tags_total") || !meta.contains("schemas_total") ) {
+			res = true;
+			return res;
+		}
+		res = ( mMetadata.rows.size() == meta["tags_total"].get<size_t>() && mMetadata.schemas() == meta["schemas_total"].get<size_t>()
+			&& ( !meta.contains("deactivated_total") || mMetadata.deactivated() == meta["deactivated_total"].get<size_t>() ) );
+		return res;
+	}
+
+	std::string PayloadAdapterHttp::metadataSnapshotPath() {
+		if ( !mConfig["adapters"]["http"].contains("config") ) { return ""; }
+		return mConfig["adapters"]["http"]["config"].value( "metadata_snapshot_path", std::string() );
+	}
+
+	std::string PayloadAdapterHttp::metadataSource() {
+		std::string urls;
+		for ( const auto& server : mConfig["adapters"]["http"]["get"] ) {
+			urls += server.value( "url", std::string() ) + "\n";
+		}
+		return picosha2::hash256_hex_string( urls );
+	}
+
 	std::vector<std::string> PayloadAdapterHttp::getTags( bool skipStructs ) {
 		if ( !ensureMetadata() ) {
 			return std::vector<std::string>();
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		std::vector<std::string> tags{};
-		tags.reserve( mPaths.size() );
-		for ( const auto& [key, value] : mPaths ) {
+		tags.reserve( snapshot->paths.size() );
+		for ( const auto& [key, value] : snapshot->paths ) {
 			if ( value->mode() == 0 ) {
 				const auto& children = value->children();
 				if ( children.size() == 0 ) {
@@ -592,6 +901,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("admin") ) {
 			res.setMsg("http adapter is not configured");
 			return res;
@@ -606,8 +917,8 @@ namespace CDB {
 		}
 
 		std::string tag_pid = "";
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag path in the database... path: " + sanitized_path );
 			return res;
 		}
@@ -653,6 +964,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("get") ) {
 			res.setMsg( "http adapter is not configured" );
 			return res;
@@ -666,8 +979,8 @@ namespace CDB {
 			return res;
 		}
 		std::string tag_pid = "";
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag path in the database... path: " + sanitized_path );
 			return res;
 		}
@@ -703,6 +1016,8 @@ namespace CDB {
 			return res;
 		}
 
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+
 		if ( !hasAccess("admin") ) {
 			res.setMsg("http adapter is not configured");
 			return res;
@@ -717,8 +1032,8 @@ namespace CDB {
 		}
 
 		std::string tag_pid = "";
-		auto tagit = mPaths.find( sanitized_path );
-		if ( tagit == mPaths.end() ) {
+		auto tagit = snapshot->paths.find( sanitized_path );
+		if ( tagit == snapshot->paths.end() ) {
 			res.setMsg( "cannot find tag path in the database... path: " + sanitized_path );
 			return res;
 		}
@@ -811,6 +1126,10 @@ namespace CDB {
 	}
 
 	Result<std::string> PayloadAdapterHttp::downloadData( const std::string& uri ) {
+		return downloadData( uri, "" );
+	}
+
+	Result<std::string> PayloadAdapterHttp::downloadData( const std::string& uri, const std::string& id ) {
 		Result<std::string> res;
 
 		if ( !uri.size() ) {
@@ -826,19 +1145,96 @@ namespace CDB {
 			return res;
 		}
 
-		std::string token = generateJWT( "get", 0 );
-		mHttpClient->setToken( token.size() ? token : "" );
-		HttpResponse r = mHttpClient->Get( uri );
+		HttpDiskCachePtr_t disk_cache = mDiskCache;
+		std::string cache_key = disk_cache ? HttpDiskCache::key( id, uri ) : "";
+		std::string cached;
+		if ( disk_cache && disk_cache->get( cache_key, cached ) ) {
+			res = std::move(cached);
+			return res;
+		}
+
+		HttpResponse r = mHttpClient->Get( uri, generateJWT( "get", serverIndex( "get", uri ) ) );
 		if ( r.error ) {
 			res.setMsg( "download of data via http(s) failed. Url: " + r.url + ", error: " + std::to_string(r.error) );
 			return res;
 		}
 
-		res = r.text;
+		if ( disk_cache ) {
+			disk_cache->put( cache_key, r.text );
+		}
+		res = std::move(r.text);
+		return res;
+	}
+
+	std::vector<Result<std::string>> PayloadAdapterHttp::downloadDataMany( const std::vector<std::string>& uris, const std::vector<std::string>& ids ) {
+		std::vector<Result<std::string>> res( uris.size() );
+
+		HttpDiskCachePtr_t disk_cache = mDiskCache;
+		std::vector<std::string> urls, cache_keys;
+		std::vector<size_t> positions;
+		for ( size_t i = 0; i < uris.size(); ++i ) {
+			auto parts = explode( uris[i], "://" );
+			if ( parts.size() != 2 ) {
+				res[i].setMsg("bad uri");
+				continue;
+			}
+			string_to_lower_case( parts[0] );
+			sanitize_alnum( parts[0] );
+			if ( !(parts[0] == "http" || parts[0] == "https" ) ) {
+				res[i].setMsg("bad uri");
+				continue;
+			}
+			std::string cache_key;
+			if ( disk_cache ) {
+				cache_key = HttpDiskCache::key( i < ids.size() ? ids[i] : "", uris[i] );
+				std::string cached;
+				if ( disk_cache->get( cache_key, cached ) ) {
+					res[i] = std::move(cached);
+					continue;
+				}
+			}
+			urls.push_back( uris[i] );
+			cache_keys.push_back( cache_key );
+			positions.push_back( i );
+		}
+		if ( urls.empty() ) {
+			return res;
+		}
+
+		std::vector<HttpResponse> replies = mHttpClient->GetMany( urls, [this]( const std::string& url ) { return generateJWT( "get", serverIndex( "get", url ) ); } );
+		for ( size_t i = 0; i < replies.size(); ++i ) {
+			if ( replies[i].error ) {
+				res[ positions[i] ].setMsg( "download of data via http(s) failed. Url: " + replies[i].url + ", error: " + std::to_string(replies[i].error) );
+				continue;
+			}
+			if ( disk_cache ) {
+				disk_cache->put( cache_keys[i], replies[i].text );
+			}
+			res[ positions[i] ] = std::move(replies[i].text);
+		}
+
 		return res;
 	}
 
 	std::string PayloadAdapterHttp::generateJWT( const std::string& access, uint64_t idx ) {
+		int64_t tm = time(0);
+		int64_t expirationSeconds = mJwtExpirationSeconds;
+		// a request may retry with the same token for as long as the retry policy allows, so every token handed
+		// out has at least that long plus a margin left: it is reused for expirationSeconds minus the margin
+		int64_t window = ( mHttpClient->retryPolicy().windowMs( mHttpClient->timeout() ) + 999 ) / 1000;
+		int64_t margin = std::max<int64_t>( 1, expirationSeconds / 5 );
+		int64_t lifetime = expirationSeconds + window;
+		std::string cache_key = access + ":" + std::to_string(idx);
+
+		// RAII scope block for the token cache
+		{
+			const std::lock_guard<std::mutex> lock(mJwtMutex);
+			auto it = mJwtCache.find( cache_key );
+			if ( it != mJwtCache.end() && it->second.second - tm > window + margin ) {
+				return it->second.first;
+			}
+		}
+
 		std::string user, pass;
 
 		try {
@@ -855,20 +1251,22 @@ namespace CDB {
 		}
 
 		jwt::jwt_object obj{ jwt::params::algorithm("HS256"), jwt::params::payload({}), jwt::params::secret(pass)};
-		int64_t tm = time(0);
-
-		uint64_t expirationSeconds = 10;
-		if ( mConfig["adapters"]["http"]["config"].contains("jwt_expiration_seconds") ) {
-			expirationSeconds = mConfig["adapters"]["http"]["config"]["jwt_expiration_seconds"].get<int64_t>();
-		}
 
 		obj.add_claim( "iat", tm )
-			.add_claim("exp", tm + expirationSeconds )
+			.add_claim("exp", tm + lifetime )
 			.add_claim("iss", user )
 			.add_claim("jti", generate_uuid() )
 			.add_claim("sub", access );
 
-		return obj.signature();
+		std::string token = obj.signature();
+
+		// RAII scope block for the token cache
+		{
+			const std::lock_guard<std::mutex> lock(mJwtMutex);
+			mJwtCache[ cache_key ] = { token, tm + lifetime };
+		}
+
+		return token;
 	}
 
 	void PayloadAdapterHttp::setHttpConfig() {
@@ -876,12 +1274,20 @@ namespace CDB {
 				|| !mConfig["adapters"]["http"].contains("config") ) {
 			return;
 		}
-		if ( mConfig["adapters"]["http"]["config"].contains("max_retries") ) {
-			mHttpClient->setMaxRetries( mConfig["adapters"]["http"]["config"]["max_retries"] );
-		}
+		mJwtExpirationSeconds = mConfig["adapters"]["http"]["config"].value( "jwt_expiration_seconds", int64_t(10) );
 		if ( mConfig["adapters"]["http"]["config"].contains("sleep_seconds") ) {
 			mHttpClient->setSleepSeconds( mConfig["adapters"]["http"]["config"]["sleep_seconds"] );
 		}
+		HttpRetryPolicy policy = mHttpClient->retryPolicy();
+		policy.maxRetries = mConfig["adapters"]["http"]["config"].value( "max_retries", policy.maxRetries );
+		policy.initialBackoffMs = mConfig["adapters"]["http"]["config"].value( "retry_initial_backoff_ms", policy.initialBackoffMs );
+		policy.maxBackoffMs = mConfig["adapters"]["http"]["config"].value( "retry_max_backoff_ms", policy.maxBackoffMs );
+		policy.deadlineMs = mConfig["adapters"]["http"]["config"].value( "retry_deadline_ms", policy.deadlineMs );
+		mHttpClient->setRetryPolicy( policy );
+		mBreakerFailures = mConfig["adapters"]["http"]["config"].value( "circuit_breaker_failures", 5u );
+		mBreakerOpenMs = mConfig["adapters"]["http"]["config"].value( "circuit_breaker_open_ms", 30000L );
+		mBreakers.clear();
+		mBalancers.clear();
 		if ( mConfig["adapters"]["http"]["config"].contains("verbose") ) {
 			mHttpClient->setVerbose( mConfig["adapters"]["http"]["config"]["verbose"] );
 		}
@@ -894,22 +1300,116 @@ namespace CDB {
 		if ( mConfig["adapters"]["http"]["config"].contains("user_agent") ) {
 			mHttpClient->setUserAgent( mConfig["adapters"]["http"]["config"]["user_agent"] );
 		}
+		if ( mConfig["adapters"]["http"]["config"].contains("max_idle_connections") ) {
+			mHttpClient->setMaxIdleHandles( mConfig["adapters"]["http"]["config"]["max_idle_connections"] );
+		}
+		if ( mConfig["adapters"]["http"]["config"].contains("max_concurrent_requests") ) {
+			mHttpClient->setMaxConcurrentRequests( mConfig["adapters"]["http"]["config"]["max_concurrent_requests"] );
+		}
+		if ( mConfig["adapters"]["http"]["config"].contains("http2") ) {
+			mHttpClient->setHttp2( mConfig["adapters"]["http"]["config"]["http2"] );
+		}
+		if ( mConfig["adapters"]["http"]["config"].contains("response_cache_mb") ) {
+			mHttpClient->setResponseCacheBytes( mConfig["adapters"]["http"]["config"]["response_cache_mb"].get<size_t>() * 1024 * 1024 );
+		}
+		if ( mConfig["adapters"]["http"]["config"].contains("disk_cache_path") ) {
+			uint64_t max_mb = mConfig["adapters"]["http"]["config"].value( "disk_cache_mb", uint64_t(1024) );
+			mDiskCache = std::make_shared<HttpDiskCache>( mConfig["adapters"]["http"]["config"]["disk_cache_path"].get<std::string>(), max_mb * 1024 * 1024 );
+		} else {
+			mDiskCache = nullptr;
+		}
+	}
+
+	void PayloadAdapterHttp::forEachServer( const std::string& access, const std::function<bool( size_t, const std::string& )>& attempt ) {
+		std::vector<size_t> ranked = loadBalancer( access )->ranked();
+		std::vector<size_t> blocked;
+		for ( size_t idx : ranked ) {
+			std::string base_url = mConfig["adapters"]["http"][access][idx]["url"].get<std::string>();
+			// asked right before the attempt: a half-open breaker hands out its one trial only to a request which is sent
+			if ( !circuitBreaker( base_url )->allow() ) {
+				blocked.push_back( idx );
+				continue;
+			}
+			if ( attempt( idx, base_url ) ) { return; }
+		}
+		if ( blocked.size() < ranked.size() ) { return; }
+		// every server looks dead: trying them anyway beats failing outright
+		for ( size_t idx : blocked ) {
+			if ( attempt( idx, mConfig["adapters"]["http"][access][idx]["url"].get<std::string>() ) ) { return; }
+		}
+	}
+
+	size_t PayloadAdapterHttp::serverIndex( const std::string& access, const std::string& url ) {
+		size_t found = 0, found_size = 0;
+		const auto& servers = mConfig["adapters"]["http"][access];
+		for ( size_t idx = 0; idx < servers.size(); ++idx ) {
+			std::string base_url = servers[idx].value( "url", std::string() );
+			if ( base_url.size() <= found_size || !string_starts_with( url, base_url ) ) { continue; }
+			// "http://a" is no prefix of "http://ab/"
+			if ( url.size() > base_url.size() && base_url.back() != '/' && url[ base_url.size() ] != '/' && url[ base_url.size() ] != '?' ) { continue; }
+			found = idx;
+			found_size = base_url.size();
+		}
+		return found;
+	}
+
+	std::shared_ptr<LoadBalancer> PayloadAdapterHttp::loadBalancer( const std::string& access ) {
+		const std::lock_guard<std::mutex> lock(mRequestMutex);
+		auto& balancer = mBalancers[ access ];
+		if ( !balancer ) {
+			balancer = std::make_shared<LoadBalancer>( mConfig["adapters"]["http"][ access ].size() );
+		}
+		return balancer;
+	}
+
+	std::shared_ptr<CircuitBreaker> PayloadAdapterHttp::circuitBreaker( const std::string& base_url ) {
+		const std::lock_guard<std::mutex> lock(mRequestMutex);
+		auto& breaker = mBreakers[ base_url ];
+		if ( !breaker ) {
+			breaker = std::make_shared<CircuitBreaker>( mBreakerFailures, std::chrono::milliseconds( mBreakerOpenMs ) );
+		}
+		return breaker;
+	}
+
+	HttpResponse PayloadAdapterHttp::requestWithFailover( const std::string& access, bool idempotent,
+			const std::function<HttpResponse( const std::string&, const std::string& )>& request ) {
+		HttpResponse r;
+		forEachServer( access, [&]( size_t idx, const std::string& base_url ) {
+			r = request( base_url, generateJWT( access, idx ) );
+			CURLcode rc = static_cast<CURLcode>( r.error );
+			if ( !r.error || !HttpRetryPolicy::isRetryable( rc, r.status_code ) ) {
+				circuitBreaker( base_url )->recordSuccess();
+				loadBalancer( access )->record( idx, r.elapsed * 1e6, true );
+				return true;
+			}
+			circuitBreaker( base_url )->recordFailure();
+			loadBalancer( access )->record( idx, r.elapsed * 1e6, false );
+			// a request which may have reached the server is not repeated elsewhere unless it is safe to
+			return !idempotent && rc != CURLE_COULDNT_CONNECT && rc != CURLE_COULDNT_RESOLVE_HOST;
+		});
+		return r;
 	}
 
 	HttpResponse PayloadAdapterHttp::makeGetRequest( const std::string& access, const std::string& url ) {
-		setHttpConfig();
-		size_t idx = RngS::Instance().random_inclusive<size_t>( 0, mConfig["adapters"]["http"][ access ].size() - 1 );
-		std::string token = generateJWT( access, idx );
-		mHttpClient->setToken( token.size() ? token : "" );
-		return mHttpClient->Get( mConfig["adapters"]["http"][access][idx]["url"].get<std::string>() + url );
+		return requestWithFailover( access, true, [this, &url]( const std::string& base_url, const std::string& token ) {
+			return mHttpClient->Get( base_url + url, token );
+		});
 	}
 
-	HttpResponse PayloadAdapterHttp::makePostRequest( const std::string& access, const std::string& url, const HttpPostParams_t& params ) {
+	HttpResponse PayloadAdapterHttp::makePostRequest( const std::string& access, const std::string& url, const HttpPostParams_t& params, bool idempotent ) {
+		return requestWithFailover( access, idempotent, [this, &url, &params]( const std::string& base_url, const std::string& token ) {
+			return mHttpClient->Post( base_url + url, params, "", "", token );
+		});
+	}
+
+	void PayloadAdapterHttp::setConfig( nlohmann::json config ) {
+		IPayloadAdapter::setConfig( config );
+		// client settings are applied once here instead of on every request
+		const std::lock_guard<std::mutex> lock(mRequestMutex);
 		setHttpConfig();
-		size_t idx = RngS::Instance().random_inclusive<size_t>( 0, mConfig["adapters"]["http"][ access ].size() - 1 );
-		std::string token = generateJWT( access, idx );
-		mHttpClient->setToken( token.size() ? token : "" );
-		return mHttpClient->Post( mConfig["adapters"]["http"][access][idx]["url"].get<std::string>() + url, params );
+		// tokens signed with the old credentials are of no use any more
+		const std::lock_guard<std::mutex> jwt_lock(mJwtMutex);
+		mJwtCache.clear();
 	}
 
 	Result<std::string> PayloadAdapterHttp::exportTagsSchemas( bool tags, bool schemas ) {
@@ -919,7 +1419,9 @@ namespace CDB {
 			res.setMsg("cannot download metadata");
 			return res;
 		}
-		if ( !mTags.size() || !mPaths.size() ) {
+
+		STagSnapshotPtr_t snapshot = tagSnapshot();
+		if ( !snapshot->tags.size() || !snapshot->paths.size() ) {
 			res.setMsg("no tags, cannot export");
 			return res;
 		}
@@ -939,7 +1441,7 @@ namespace CDB {
 			output["schemas"] = nlohmann::json::array();
 		}
 
-		for ( const auto& [ key, value ] : mPaths ) {
+		for ( const auto& [ key, value ] : snapshot->paths ) {
 			if ( tags ) {
 				output["tags"].push_back( value->toJson() );
 			}
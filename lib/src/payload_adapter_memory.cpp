@@ -2,7 +2,8 @@
 #include "npp/cdb/payload_adapter_memory.h"
 
 #include <algorithm>
-#include <shared_mutex>
+#include <limits>
+#include <unordered_set>
 
 #include "npp/util/log.h"
 
@@ -11,11 +12,28 @@ namespace CDB {
 
 	using namespace NPP::Util;
 
-	std::shared_mutex cdbnpp_memory_mutex;
-	typedef std::unique_lock<std::shared_mutex>  WriteLock;
-	typedef std::shared_lock<std::shared_mutex>  ReadLock;
+	namespace {
+		std::atomic<uint64_t> gMemoryAdapterInstances{0};
 
-	PayloadAdapterMemory::PayloadAdapterMemory() : IPayloadAdapter("memory") {}
+		// a reader leaves its epoch however the lookup ends, exceptions included: a slot left pinned would keep
+		// every map retired from then on
+		struct EpochGuard {
+			std::atomic<uint64_t>& epoch;
+			~EpochGuard() { epoch.store( 0, std::memory_order_release ); }
+		};
+	}
+
+	PayloadAdapterMemory::PayloadAdapterMemory() : IPayloadAdapter("memory"), mInstance( ++gMemoryAdapterInstances ) {}
+
+	PayloadAdapterMemory::~PayloadAdapterMemory() {
+		// lookups must be over by now, so nothing can see these maps any more
+		for ( auto& shard : mShards ) {
+			delete shard.map.load();
+		}
+		for ( const auto& retired : mRetired ) {
+			delete retired.map;
+		}
+	}
 
 	PayloadResults_t PayloadAdapterMemory::getPayloads( const std::set<std::string>& paths, const std::vector<std::string>& flavors,
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
@@ -33,7 +51,6 @@ namespace CDB {
 	Result<SPayloadPtr_t> PayloadAdapterMemory::getPayload( const std::string& path, const std::vector<std::string>& service_flavors,
 			const PathToTimeMap_t& maxEntryTimeOverrides, int64_t maxEntryTime, int64_t eventTime, int64_t run, int64_t seq ) {
 		Result<SPayloadPtr_t> res;
-		ReadLock lock(cdbnpp_memory_mutex);
 
 		auto [ flavors, directory, structName, is_path_valid ] = Payload::decodePath( path );
 
@@ -68,49 +85,122 @@ namespace CDB {
 			}
 		}
 
-		for ( const auto& flavor : ( flavors.size() ? flavors : service_flavors ) ) {
-			// "directory = directory" because clang cannot capture it, it is a c++ standard issue until c++20
-			auto it = std::find_if( mCache.begin(), mCache.end(), [ &flavor, directory = directory, structName = structName, eventTime, maxEntryTime, run, seq ]( const auto& item ) {
-					return ( item->flavor() == flavor && item->structName() == structName
-							&& item->directory() == directory
-							&& ( maxEntryTime > 0 ? ( item->createTime() <= maxEntryTime ) : true )
-							&& ( maxEntryTime > 0 && item->deactiveTime() > 0 ? item->deactiveTime() < maxEntryTime : true )
-							&& (
-								( item->mode() == 1
-								  && item->beginTime() <= eventTime && item->endTime() >= eventTime 
-								) || ( item->mode() == 2
-									&& item->run() == run
-									&& item->seq() == seq
-								     )
-							   )
-					       );
-					});
-			if ( it == mCache.end() ) {	continue;	}
-			res = SPayloadPtr_t(*it);
-			return res;
+		// payload is visible if it was created before maxEntryTime and was not deactivated by then
+		auto is_visible = [ maxEntryTime ]( const SPayloadPtr_t& item ) {
+			return ( maxEntryTime <= 0 || ( item->createTime() <= maxEntryTime
+				&& ( item->deactiveTime() == 0 || item->deactiveTime() > maxEntryTime ) ) );
+		};
+
+		// no lock and no shared reference count: the thread announces the epoch it reads in, and writers free
+		// a replaced map only once every reader that could have loaded it has left that epoch
+		ReaderSlot& reader = readerSlot();
+		CacheEntry* found = nullptr;
+		{ // RAII scope block for the reader epoch
+			reader.epoch.store( mEpoch.load() );
+			EpochGuard guard{ reader.epoch };
+			const ShardMap_t* snapshot = mShards[ shardIndex( directory, structName ) ].map.load();
+
+			for ( const auto& flavor : ( flavors.size() ? flavors : service_flavors ) ) {
+				auto bucketit = snapshot->find( cacheKey( flavor, directory, structName ) );
+				if ( bucketit == snapshot->end() ) { continue; }
+				const CacheBucket& bucket = *bucketit->second;
+
+				// mode = 2: exact match by run, seq => pick the most recent entry
+				auto [ rbegin, rend ] = bucket.byRun.equal_range({ run, seq });
+				for ( auto it = rbegin; it != rend; ++it ) {
+					if ( is_visible( it->second->payload ) && ( !found || it->second->payload->createTime() > found->payload->createTime() ) ) {
+						found = it->second.get();
+					}
+				}
+
+				// mode = 1: closest beginTime <= eventTime, walking backwards until endTime covers eventTime
+				if ( !found && bucket.byTime.size() ) {
+					auto it = std::upper_bound( bucket.byTime.begin(), bucket.byTime.end(), eventTime,
+						[]( int64_t time, const TimeSlot& slot ) { return time < slot.beginTime; } );
+					while ( it != bucket.byTime.begin() ) {
+						--it;
+						if ( it->maxEndTime <= eventTime ) { break; } // no interval this early reaches eventTime, a miss
+						if ( it->endTime > eventTime && is_visible( it->entry->payload ) ) {
+							found = it->entry.get();
+							break;
+						}
+					}
+				}
+
+				if ( found ) { break; }
+			}
+
+			if ( found ) {
+				// hits advance the insertion tick too, so lru sees every access in order; an entry already
+				// holding the newest tick is the most recent one, skipping it keeps repeated hits off the shared clock
+				if ( found->accessed.load( std::memory_order_relaxed ) != mTick.load( std::memory_order_relaxed ) ) {
+					found->accessed.store( mTick.fetch_add( 1, std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
+				}
+				found->hits.fetch_add( 1, std::memory_order_relaxed );
+				res = found->payload;
+			}
 		}
 
+		// only this thread writes its counters, a plain store is enough
+		std::atomic<uint64_t>& counter = found ? reader.hits : reader.misses;
+		counter.store( counter.load( std::memory_order_relaxed ) + 1, std::memory_order_relaxed );
 		return res;
 	}
 
 	Result<std::string> PayloadAdapterMemory::setPayload( const SPayloadPtr_t& payload ) {
 		Result<std::string> res;
 
-		if ( !payload->ready() || payload->endTime() == 0 ) {
+		if ( !payload->ready() || ( payload->mode() == 1 && payload->endTime() == 0 ) ) {
 			res.setMsg("payload is not ready or endTime is not set");
 			return res;
 		}
 
-		WriteLock lock(cdbnpp_memory_mutex);
-		// add to cache
-		mCache.push_back( payload );
-		mCacheSizeBytes += payload->dataSize();
-		maintainCacheWithinLimits();
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		// add to cache, same payload object is cached only once
+		if ( mEntries.find( payload.get() ) == mEntries.end() ) {
+			SCacheEntryPtr_t entry = std::make_shared<CacheEntry>( payload, ++mTick );
+			mEntries.insert({ payload.get(), entry });
+			updateIndex( { entry }, {} );
+			countEntry( *entry );
+			mCacheItemCount = mEntries.size();
+			mInsertions.fetch_add( 1, std::memory_order_relaxed );
+			maintainCacheWithinLimits();
+		}
 		res = std::string(payload->id());
 
 		return res;
 	}
 
+	CacheInsertion PayloadAdapterMemory::setPayloads( const PayloadList_t& payloads ) {
+		CacheInsertion res;
+
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		std::vector<SCacheEntryPtr_t> added;
+		added.reserve( payloads.size() );
+		for ( const auto& payload : payloads ) {
+			if ( !payload->ready() || ( payload->mode() == 1 && payload->endTime() == 0 ) ) { continue; }
+			if ( mEntries.find( payload.get() ) != mEntries.end() ) { continue; }
+			SCacheEntryPtr_t entry = std::make_shared<CacheEntry>( payload, ++mTick );
+			mEntries.insert({ payload.get(), entry });
+			countEntry( *entry );
+			added.push_back( entry );
+		}
+		if ( added.empty() ) { return res; }
+
+		// one copy of every touched shard and bucket for the whole list, rather than one per payload
+		updateIndex( added, {} );
+		mCacheItemCount = mEntries.size();
+		mInsertions.fetch_add( added.size(), std::memory_order_relaxed );
+		maintainCacheWithinLimits();
+
+		res.inserted = added.size();
+		res.evicted = std::count_if( added.begin(), added.end(), [this]( const SCacheEntryPtr_t& entry ) {
+			auto it = mEntries.find( entry->payload.get() );
+			return it == mEntries.end() || it->second != entry;
+		});
+		return res;
+	}
+
 	Result<std::string> PayloadAdapterMemory::deactivatePayload( __attribute__((unused)) const SPayloadPtr_t& payload, __attribute__((unused)) int64_t deactiveTime ) {
 		Result<std::string> res;
 		res.setMsg( "memory adapter cannot deactivate payloads" );
@@ -141,21 +231,228 @@ namespace CDB {
 		return res;
 	}
 
+	void PayloadAdapterMemory::updateIndex( const std::vector<SCacheEntryPtr_t>& added, const std::vector<SCacheEntryPtr_t>& removed ) {
+		// group changes by shard, so that every touched shard and bucket is copied once
+		std::array<std::vector<std::pair<SCacheEntryPtr_t,bool>>, CACHE_SHARDS> changes{};
+		for ( const auto& entry : added ) {
+			changes[ shardIndex( entry->payload->directory(), entry->payload->structName() ) ].push_back({ entry, true });
+		}
+		for ( const auto& entry : removed ) {
+			changes[ shardIndex( entry->payload->directory(), entry->payload->structName() ) ].push_back({ entry, false });
+		}
+
+		for ( size_t idx = 0; idx < CACHE_SHARDS; ++idx ) {
+			if ( changes[idx].empty() ) { continue; }
+			CacheShard& shard = mShards[idx];
+			ShardMap_t* map = new ShardMap_t( *shard.map.load() );
+			std::unordered_map<std::string, std::shared_ptr<CacheBucket>> buckets{}; // copies being modified
+			std::unordered_map<CacheBucket*, std::unordered_set<const CacheEntry*>> removedSlots{}; // dropped in one pass below
+
+			for ( const auto& [ entry, is_added ] : changes[idx] ) {
+				const SPayloadPtr_t& payload = entry->payload;
+				std::string key = cacheKey( payload->flavor(), payload->directory(), payload->structName() );
+				auto bucketit = buckets.find( key );
+				if ( bucketit == buckets.end() ) {
+					auto mapit = map->find( key );
+					std::shared_ptr<CacheBucket> bucket = mapit != map->end() ? std::make_shared<CacheBucket>( *mapit->second ) : std::make_shared<CacheBucket>();
+					bucketit = buckets.insert({ key, bucket }).first;
+				}
+				CacheBucket& bucket = *bucketit->second;
+
+				if ( is_added ) {
+					if ( payload->mode() == 2 ) {
+						bucket.byRun.insert({ { payload->run(), payload->seq() }, entry });
+					} else {
+						bucket.byTime.push_back({ payload->beginTime(), payload->endTime(), 0, entry }); // sorted below
+					}
+				} else if ( payload->mode() == 2 ) {
+					auto [ begin, end ] = bucket.byRun.equal_range({ payload->run(), payload->seq() });
+					auto it = std::find_if( begin, end, [&entry]( const auto& item ) { return item.second == entry; } );
+					if ( it != end ) { bucket.byRun.erase( it ); }
+				} else {
+					removedSlots[ &bucket ].insert( entry.get() );
+				}
+			}
+
+			// restore the order and running maximum once per bucket, however many entries changed
+			for ( auto& [ key, bucket ] : buckets ) {
+				auto removedit = removedSlots.find( bucket.get() );
+				if ( removedit != removedSlots.end() ) {
+					const auto& removed = removedit->second;
+					bucket->byTime.erase( std::remove_if( bucket->byTime.begin(), bucket->byTime.end(),
+						[&removed]( const TimeSlot& slot ) { return removed.count( slot.entry.get() ); } ), bucket->byTime.end() );
+				}
+				std::stable_sort( bucket->byTime.begin(), bucket->byTime.end(), []( const TimeSlot& a, const TimeSlot& b ) { return a.beginTime < b.beginTime; } );
+				int64_t maxEndTime = std::numeric_limits<int64_t>::min();
+				for ( auto& slot : bucket->byTime ) {
+					maxEndTime = std::max( maxEndTime, slot.endTime );
+					slot.maxEndTime = maxEndTime;
+				}
+			}
+
+			for ( auto& [ key, bucket ] : buckets ) {
+				if ( bucket->byTime.empty() && bucket->byRun.empty() ) {
+					map->erase( key );
+				} else {
+					(*map)[ key ] = std::move( bucket );
+				}
+			}
+			const ShardMap_t* replaced = shard.map.exchange( map );
+			mRetired.push_back({ replaced, mEpoch.fetch_add( 1 ) });
+		}
+		reclaimRetired();
+	}
+
+	void PayloadAdapterMemory::reclaimRetired() {
+		if ( mRetired.empty() ) { return; }
+		// a reader that announced an epoch after a map was replaced loads its successor, so a retired map is
+		// only reachable by readers still in its epoch or an earlier one
+		uint64_t oldest = std::numeric_limits<uint64_t>::max();
+		{
+			std::lock_guard<std::mutex> lock(mReadersMutex);
+			for ( const auto& reader : mReaders ) {
+				uint64_t epoch = reader->epoch.load();
+				if ( epoch != 0 ) { oldest = std::min( oldest, epoch ); }
+			}
+		}
+		auto kept = std::remove_if( mRetired.begin(), mRetired.end(), [oldest]( const RetiredMap& retired ) {
+			if ( retired.epoch >= oldest ) { return false; }
+			delete retired.map;
+			return true;
+		});
+		mRetired.erase( kept, mRetired.end() );
+	}
+
+	PayloadAdapterMemory::ReaderSlot& PayloadAdapterMemory::readerSlot() {
+		// slots of the calling thread, one per adapter it has read from, handed back when the thread exits
+		struct ThreadSlots {
+			std::vector<std::pair<uint64_t, SReaderSlotPtr_t>> slots{};
+			~ThreadSlots() {
+				for ( auto& item : slots ) { item.second->used.store( false, std::memory_order_release ); }
+			}
+		};
+		static thread_local ThreadSlots local;
+		for ( const auto& [ instance, slot ] : local.slots ) {
+			if ( instance == mInstance ) { return *slot; }
+		}
+
+		// first lookup of this thread here: drop slots of adapters that are gone, then reuse a free slot
+		local.slots.erase( std::remove_if( local.slots.begin(), local.slots.end(),
+			[]( const auto& item ) { return item.second.use_count() == 1; } ), local.slots.end() );
+		SReaderSlotPtr_t slot{nullptr};
+		{
+			std::lock_guard<std::mutex> lock(mReadersMutex);
+			for ( const auto& candidate : mReaders ) {
+				bool used = false;
+				if ( candidate->used.compare_exchange_strong( used, true ) ) {
+					slot = candidate;
+					break;
+				}
+			}
+			if ( !slot ) {
+				slot = std::make_shared<ReaderSlot>();
+				mReaders.push_back( slot );
+			}
+		}
+		local.slots.push_back({ mInstance, slot });
+		return *slot;
+	}
+
 	bool PayloadAdapterMemory::maintainCacheWithinLimits() {
-		ReadLock r_lock(cdbnpp_memory_mutex);
-		if ( mCache.size() <= 1 ) { return false; }
-		if ( mCacheSizeBytes < mCacheSizeLimitHi && mCache.size() < mCacheItemLimitHi ) { return false; }
-		r_lock.unlock();
+		if ( mEntries.size() <= 1 ) { return false; }
+		if ( mCacheSizeBytes < mCacheSizeLimitHi && mEntries.size() < mCacheItemLimitHi ) { return false; }
+
+		// snapshot usage counters and order entries by the eviction policy, first to go in front
+		std::vector<std::pair<CacheEntryStats, SCacheEntryPtr_t>> candidates;
+		candidates.reserve( mEntries.size() );
+		for ( const auto& [ ptr, entry ] : mEntries ) {
+			candidates.push_back({ CacheEntryStats{ entry->inserted, entry->accessed.load( std::memory_order_relaxed ),
+				entry->hits.load( std::memory_order_relaxed ), entry->bytes }, entry });
+		}
+		std::sort( candidates.begin(), candidates.end(), [this]( const auto& a, const auto& b ) {
+			return mEvictionPolicy->evictBefore( a.first, b.first );
+		});
+
 		// if cache size in bytes or in item count is bigger than HI limit, bring it down to LO limit
-		WriteLock w_lock(cdbnpp_memory_mutex);
-		while ( mCacheSizeBytes > mCacheSizeLimitLo || mCache.size() > mCacheItemLimitLo ) {
-			size_t sz = mCache.front()->dataSize();
-			mCache.pop_front();
-			mCacheSizeBytes -= sz;
+		std::vector<SCacheEntryPtr_t> evicted;
+		for ( const auto& [ stats, entry ] : candidates ) {
+			if ( mCacheSizeBytes <= mCacheSizeLimitLo && mEntries.size() <= mCacheItemLimitLo ) { break; }
+			mEntries.erase( entry->payload.get() );
+			mCacheSizeBytes -= entry->bytes;
+			mCacheMappedBytes -= entry->mappedBytes;
+			evicted.push_back( entry );
 		}
+		updateIndex( {}, evicted );
+		mCacheItemCount = mEntries.size();
+		mEvictions.fetch_add( evicted.size(), std::memory_order_relaxed );
 		return true;
 	}
 
+	void PayloadAdapterMemory::countEntry( CacheEntry& entry ) {
+		// mapped data lives in the page cache, shared with other processes, so it is reported but not limited;
+		// unsigned wrap-around makes the difference work both ways
+		// data is only read once published, a fetch in progress on another thread counts as no data yet
+		bool has_data = entry.payload->hasData();
+		size_t size = has_data ? entry.payload->dataSize() : 0, bytes = has_data && entry.payload->dataMapped() ? 0 : size, mapped = size - bytes;
+		mCacheSizeBytes.fetch_add( bytes - entry.bytes, std::memory_order_relaxed );
+		mCacheMappedBytes.fetch_add( mapped - entry.mappedBytes, std::memory_order_relaxed );
+		entry.bytes = bytes;
+		entry.mappedBytes = mapped;
+	}
+
+	void PayloadAdapterMemory::updatePayloadSize( const SPayloadPtr_t& payload ) {
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		auto it = mEntries.find( payload.get() );
+		if ( it == mEntries.end() ) { return; }
+		countEntry( *it->second );
+		maintainCacheWithinLimits();
+	}
+
+	bool PayloadAdapterMemory::setEvictionPolicy( const std::string& policy_id ) {
+		ICacheEvictionPolicyPtr_t policy = makeCacheEvictionPolicy( policy_id );
+		if ( !policy ) {
+			CDBNPP_LOG_ERROR << "unknown memory cache eviction policy: " << policy_id << std::endl;
+			return false;
+		}
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		mEvictionPolicy = policy;
+		return true;
+	}
+
+	std::string PayloadAdapterMemory::evictionPolicy() {
+		std::lock_guard<std::mutex> lock(mWriteMutex);
+		return mEvictionPolicy->id();
+	}
+
+	CacheStats PayloadAdapterMemory::cacheStats() {
+		CacheStats stats;
+		{
+			std::lock_guard<std::mutex> lock(mReadersMutex);
+			for ( const auto& reader : mReaders ) {
+				stats.hits += reader->hits.load( std::memory_order_relaxed );
+				stats.misses += reader->misses.load( std::memory_order_relaxed );
+			}
+		}
+		stats.insertions = mInsertions.load( std::memory_order_relaxed );
+		stats.evictions = mEvictions.load( std::memory_order_relaxed );
+		stats.items = mCacheItemCount.load( std::memory_order_relaxed );
+		stats.bytes = mCacheSizeBytes.load( std::memory_order_relaxed );
+		stats.mapped_bytes = mCacheMappedBytes.load( std::memory_order_relaxed );
+		return stats;
+	}
+
+	void PayloadAdapterMemory::resetCacheStats() {
+		{
+			std::lock_guard<std::mutex> lock(mReadersMutex);
+			for ( auto& reader : mReaders ) {
+				reader->hits.store( 0, std::memory_order_relaxed );
+				reader->misses.store( 0, std::memory_order_relaxed );
+			}
+		}
+		mInsertions = 0;
+		mEvictions = 0;
+	}
+
 	Result<std::string> PayloadAdapterMemory::downloadData( __attribute__((unused)) const std::string& uri ) {
 		Result<std::string> res;
 		res.setMsg("memory (aka caching) adapter does not resolve uri by design");
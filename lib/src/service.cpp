@@ -109,6 +109,10 @@ namespace CDB {
 					PayloadAdapterMemory* aptr = dynamic_cast<PayloadAdapterMemory*>( mPayloadAdapterMemory.get() );
 					aptr->setCacheItemLimit( mConfig["adapters"]["memory"]["cache_item_limit"]["lo"], mConfig["adapters"]["memory"]["cache_item_limit"]["hi"] );
 				}
+				if ( mConfig["adapters"]["memory"].contains("eviction_policy") ) {
+					PayloadAdapterMemory* aptr = dynamic_cast<PayloadAdapterMemory*>( mPayloadAdapterMemory.get() );
+					aptr->setEvictionPolicy( mConfig["adapters"]["memory"]["eviction_policy"] );
+				}
 				mEnabledAdapters.push_back( mPayloadAdapterMemory );
 			} else if ( adapter == "file" ) {
 				mEnabledAdapters.push_back( mPayloadAdapterFile );
@@ -118,6 +122,13 @@ namespace CDB {
 				mEnabledAdapters.push_back( mPayloadAdapterHttp );
 			}
 		}
+
+		// payload data is downloaded by a pool of workers, none means on the calling thread
+		size_t fetch_threads = 4;
+		if ( mConfig.contains("service") && mConfig["service"].contains("fetch_threads") ) {
+			fetch_threads = mConfig["service"]["fetch_threads"].get<size_t>();
+		}
+		mFetchPool = std::make_unique<ThreadPool>( fetch_threads );
 	}
 
 	std::vector<std::string> Service::enabledAdapters() {
@@ -143,7 +154,7 @@ namespace CDB {
 				if ( !ok ) {
 					CDBNPP_LOG_DEBUG << "WARNING: " << value->flavor() + ":" + value->directory() + "/" + value->structName() << " was already resolved, cannot insert again!" << std::endl;
 				}
-				if ( adapter->id() != "memory" && adapter->id() != "file" && mPayloadAdapterMemory != nullptr ) {
+				if ( adapter->id() != "memory" && adapter->id() != "file" && isEnabledMemory() ) {
 					mPayloadAdapterMemory->setPayload( value );
 				}
 			}
@@ -153,18 +164,114 @@ namespace CDB {
 		}
 
 		if ( fetch_data ) {
+			// downloads run concurrently, results are complete once all of them are done
+			std::vector<std::future<Result<bool>>> downloads;
+			std::vector<SPayloadPtr_t> http_payloads;
 			for ( auto& [ key, value ] : res ) {
-				if ( !value->data().size() ) {
-					resolveURI( value );
+				if ( !value->hasData() ) {
+					SPayloadPtr_t payload = value;
+					if ( mPayloadAdapterHttp && ( string_starts_with( payload->URI(), "http://" ) || string_starts_with( payload->URI(), "https://" ) ) ) {
+						http_payloads.push_back( payload );
+						continue;
+					}
+					downloads.push_back( mFetchPool->submit( [this, payload]() mutable { return resolveURI( payload ); } ) );
+				}
+			}
+			// http downloads share one curl multi handle on this thread, while the pool takes care of the rest
+			if ( http_payloads.size() > 1 ) {
+				std::vector<std::string> uris, ids;
+				for ( const auto& payload : http_payloads ) {
+					uris.push_back( payload->URI() );
+					ids.push_back( payload->id() );
+				}
+				PayloadAdapterHttp* aptr = dynamic_cast<PayloadAdapterHttp*>( mPayloadAdapterHttp.get() );
+				std::vector<Result<std::string>> data = aptr->downloadDataMany( uris, ids );
+				for ( size_t i = 0; i < http_payloads.size(); ++i ) {
+					if ( data[i].valid() ) {
+						// another thread sharing the payload may have filled it meanwhile, then this copy is dropped
+						Result<bool> attached = http_payloads[i]->fetchDataOnce( [&data, i]() { return Result<SharedBuffer>( SharedBuffer( std::move( data[i] ).get() ) ); } );
+						if ( attached.valid() && attached.get() ) {
+							updateCachedSize( http_payloads[i] );
+						}
+					} else {
+						CDBNPP_LOG_ERROR << "cannot download " << uris[i] << ": " << data[i].msg() << std::endl;
+					}
+				}
+			} else if ( http_payloads.size() == 1 ) {
+				resolveURI( http_payloads[0] );
+			}
+			for ( auto& download : downloads ) {
+				download.wait();
+			}
+		}
+
+		return res;
+	}
+
+	PayloadFutures_t Service::getPayloadsAsync( const std::set<std::string>& paths ) {
+		PayloadFutures_t res{};
+
+		for ( auto& [ key, value ] : getPayloads( paths, false ) ) {
+			SPayloadPtr_t payload = value;
+			res.insert({ key, mFetchPool->submit( [this, payload]() mutable {
+				Result<SPayloadPtr_t> rc;
+				if ( !payload->hasData() ) {
+					Result<bool> fetched = resolveURI( payload );
+					if ( fetched.invalid() ) {
+						rc.setMsg( fetched.msg() );
+						return rc;
+					}
 				}
+				rc = payload;
+				return rc;
+			}) });
+		}
+
+		return res;
+	}
+
+	Result<size_t> Service::prefetch( const std::set<std::string>& paths, int64_t beginTime, int64_t endTime ) {
+		return prefetchRange( paths, beginTime, endTime, false );
+	}
+
+	Result<size_t> Service::prefetchByRun( const std::set<std::string>& paths, int64_t runBegin, int64_t runEnd ) {
+		return prefetchRange( paths, runBegin, runEnd, true );
+	}
+
+	Result<size_t> Service::prefetchRange( const std::set<std::string>& paths, int64_t rangeBegin, int64_t rangeEnd, bool byRun ) {
+		Result<size_t> res;
+
+		if ( !isEnabledMemory() ) {
+			res.setMsg( "memory adapter is not enabled, nowhere to prefetch into" );
+			return res;
+		}
+
+		if ( rangeEnd < rangeBegin ) {
+			res.setMsg( "prefetch range end is before its begin" );
+			return res;
+		}
+
+		// first adapter able to serve the range wins, cache limits of the memory adapter still apply
+		for ( auto& adapter : mEnabledAdapters ) {
+			if ( adapter->id() == "memory" ) { continue; }
+			PayloadList_t payloads = adapter->prefetchPayloads( paths, mFlavors, mMaxEntryTimeOverrides, mMaxEntryTime, rangeBegin, rangeEnd, byRun );
+			if ( !payloads.size() ) { continue; }
+			CacheInsertion cached = dynamic_cast<PayloadAdapterMemory*>( mPayloadAdapterMemory.get() )->setPayloads( payloads );
+			if ( cached.evicted ) {
+				CDBNPP_LOG_INFO << "WARNING: prefetch of " << cached.inserted << " payloads exceeded the memory cache limits, "
+					<< cached.evicted << " of them were evicted right away" << std::endl;
 			}
+			res = cached.inserted - cached.evicted;
+			return res;
 		}
 
+		res = size_t{0};
 		return res;
 	}
 
 	Result<std::string> Service::setPayload( const SPayloadPtr_t& payload ) {
 		Result<std::string> res;
+		compressPayload( payload );
 		for ( auto& adapter : mEnabledAdapters ) {
 			if ( adapter->id() == "memory" ) { continue; }
 			res = adapter->setPayload( payload );
@@ -283,8 +390,8 @@ namespace CDB {
 
 	Result<bool> Service::resolveURI( SPayloadPtr_t& payload ) {
 		Result<bool> res;
-		if ( payload->dataSize() ) {
-			res.setMsg("payload already contains data");
+		if ( payload->hasData() ) { // i.e. filled by another thread sharing it through the memory cache
+			res = true;
 			return res;
 		}
 
@@ -298,28 +405,74 @@ namespace CDB {
 		string_to_lower_case( parts[0] );
 		sanitize_alnum( parts[0] );
 
-		Result<std::string> data;
-		if ( parts[0] == "file" ) {
-			data = mPayloadAdapterFile->downloadData( uri );
-		} else if ( parts[0] == "http" || parts[0] == "https" ) {
-			data = mPayloadAdapterHttp->downloadData( uri );
-		} else if ( parts[0] == "db" ) {
-			data = mPayloadAdapterDb->downloadData( uri );
-		} else {
+		if ( !( parts[0] == "file" && mPayloadAdapterFile ) && !( ( parts[0] == "http" || parts[0] == "https" ) && mPayloadAdapterHttp )
+				&& !( parts[0] == "db" && mPayloadAdapterDb ) ) {
 			res.setMsg("unknown uri");
+			return res;
 		}
 
-		if ( data.valid() ) {
-			auto fparts = explode( parts[1], "." );
-			std::string fmt = fparts.back();
-			sanitize_alnum(fmt);
-			string_to_lower_case(fmt);
-			payload->setData( data.get(), fmt );
+		// threads sharing the payload download it once, the others wait for the first one
+		Result<bool> attached = payload->fetchDataOnce( [&]() {
+			Result<SharedBuffer> data;
+			if ( parts[0] == "file" ) {
+				// large files are mapped rather than read, their pages are shared by all processes on the node
+				return dynamic_cast<PayloadAdapterFile*>( mPayloadAdapterFile.get() )->mapData( uri );
+			}
+			Result<std::string> downloaded = parts[0] == "db" ? mPayloadAdapterDb->downloadData( uri )
+				: dynamic_cast<PayloadAdapterHttp*>( mPayloadAdapterHttp.get() )->downloadData( uri, payload->id() );
+			if ( downloaded.valid() ) {
+				data = SharedBuffer( std::move( downloaded ).get() );
+			} else {
+				data.setMsg( downloaded.msg() );
+			}
+			return data;
+		});
+
+		if ( attached.invalid() ) {
+			res.setMsg( "cannot download " + uri + ": " + attached.msg() );
+			return res;
 		}
+		if ( attached.get() ) {
+			updateCachedSize( payload );
+		}
+
+		res = true;
 
 		return res;
 	}
 
+	void Service::updateCachedSize( const SPayloadPtr_t& payload ) {
+		// payloads are cached before their data is downloaded, the memory adapter counts it once it is there
+		if ( !isEnabledMemory() ) { return; }
+		dynamic_cast<PayloadAdapterMemory*>( mPayloadAdapterMemory.get() )->updatePayloadSize( payload );
+	}
+
+	void Service::compressPayload( const SPayloadPtr_t& payload ) {
+		if ( !payload->dataSize() || payload->codec().size() || !mConfig.contains("service") || !mConfig["service"].contains("compression") ) {
+			return;
+		}
+		const nlohmann::json& cfg = mConfig["service"]["compression"];
+		if ( payload->dataSize() < cfg.value( "min_size", size_t(1024) ) ) { return; }
+
+		// global codec, unless overridden for the struct or one of its parent directories, the longest path wins
+		std::string codec = cfg.value( "codec", std::string("none") ), path = payload->directory() + "/" + payload->structName();
+		size_t matched = 0;
+		if ( cfg.contains("paths") ) {
+			for ( const auto& [ prefix, value ] : cfg["paths"].items() ) {
+				if ( prefix.size() > matched && ( path == prefix || string_starts_with( path, prefix + "/" ) ) ) {
+					codec = value.get<std::string>();
+					matched = prefix.size();
+				}
+			}
+		}
+		if ( codec == "none" ) { return; }
+
+		Result<bool> rc = payload->compress( codec, cfg.value( "level", 0 ) );
+		if ( rc.invalid() ) {
+			CDBNPP_LOG_ERROR << "storing " << path << " uncompressed: " << rc.msg() << std::endl;
+		}
+	}
+
 	Result<bool> Service::validateConfigFile() {
 		Result<bool> res;
 		std::string config_schema = R"(
@@ -332,6 +485,38 @@ namespace CDB {
     "adapters"
   ],
   "properties":{
+    "service":{
+      "type":"object",
+      "properties":{
+        "fetch_threads":{
+          "type":"integer",
+          "minimum":0
+        },
+        "compression":{
+          "type":"object",
+          "properties":{
+            "codec":{
+              "type":"string",
+              "enum":[ "none", "zstd", "lz4" ]
+            },
+            "level":{
+              "type":"integer"
+            },
+            "min_size":{
+              "type":"integer",
+              "minimum":0
+            },
+            "paths":{
+              "type":"object",
+              "additionalProperties":{
+                "type":"string",
+                "enum":[ "none", "zstd", "lz4" ]
+              }
+            }
+          }
+        }
+      }
+    },
     "adapters":{
       "type":"object",
       "properties":{
@@ -367,6 +552,15 @@ namespace CDB {
                   "min":0
                 }
               }
+            },
+            "eviction_policy":{
+              "type":"string",
+              "enum":[
+                "fifo",
+                "lru",
+                "lfu",
+                "size"
+              ]
             }
           }
         },
@@ -378,6 +572,14 @@ namespace CDB {
           "properties":{
             "dirname":{
               "type":"string"
+            },
+            "index_ttl_seconds":{
+              "type":"integer",
+              "minimum":0
+            },
+            "mmap_min_size":{
+              "type":"integer",
+              "minimum":0
             }
           }
         },
@@ -555,6 +757,41 @@ namespace CDB {
 						     }
 					     }
 				     }
+			     },
+			     "config":{
+				     "type":"object",
+				     "properties":{
+					     "pool_size":{
+						     "type":"object",
+						     "properties":{
+							     "get":{
+								     "type":"integer",
+								     "minimum":1
+							     },
+							     "set":{
+								     "type":"integer",
+								     "minimum":1
+							     },
+							     "admin":{
+								     "type":"integer",
+								     "minimum":1
+							     }
+						     }
+					     },
+					     "pool_timeout_ms":{
+						     "type":"integer"
+					     },
+					     "batch_size":{
+						     "type":"integer",
+						     "minimum":0
+					     },
+					     "single_query_iov":{
+						     "type":"boolean"
+					     },
+					     "metadata_snapshot_path":{
+						     "type":"string"
+					     }
+				     }
 			     }
 		     }
 	     }
@@ -0,0 +1,173 @@
+#include "npp/cdb/tag_metadata.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <system_error>
+
+#include <unistd.h>
+
+#include "npp/util/log.h"
+#include "npp/util/util.h"
+
+namespace NPP {
+namespace CDB {
+
+	using namespace NPP::Util;
+
+	namespace fs = std::filesystem;
+
+	namespace {
+
+		// PDO drivers may hand integers over as strings
+		int64_t rowInt( const nlohmann::json& row, const char* key ) {
+			auto it = row.find( key );
+			if ( it == row.end() || it->is_null() ) { return 0; }
+			if ( it->is_number() ) { return it->get<int64_t>(); }
+			if ( it->is_string() ) {
+				try {
+					return std::stoll( it->get<std::string>() );
+				} catch ( std::exception const & e ) {
+					return 0;
+				}
+			}
+			return 0;
+		}
+
+		std::string rowString( const nlohmann::json& row, const char* key ) {
+			auto it = row.find( key );
+			return ( it == row.end() || !it->is_string() ) ? "" : it->get<std::string>();
+		}
+
+	} // namespace
+
+	size_t TagMetadata::merge( const nlohmann::json& tags ) {
+		if ( !tags.is_array() ) { return 0; }
+		size_t merged = 0;
+		for ( const auto& it : tags ) {
+			std::string id = rowString( it, "id" );
+			if ( !id.size() ) { continue; }
+			nlohmann::json row = {
+				{ "id", id }, { "name", rowString( it, "name" ) }, { "pid", rowString( it, "pid" ) }, { "tbname", rowString( it, "tbname" ) },
+				{ "ct", rowInt( it, "ct" ) }, { "dt", rowInt( it, "dt" ) }, { "mode", rowInt( it, "mode" ) },
+				{ "schema_id", rowString( it, "schema_id" ) }, { "schema_ct", rowInt( it, "schema_ct" ) }
+			};
+			synced = std::max({ synced, row["ct"].get<int64_t>(), row["dt"].get<int64_t>(), row["schema_ct"].get<int64_t>() });
+			rows[ id ] = std::move(row);
+			++merged;
+		}
+		return merged;
+	}
+
+	void TagMetadata::add( const STagPtr_t& tag ) {
+		nlohmann::json row = {
+			{ "id", tag->id() }, { "name", tag->name() }, { "pid", tag->pid() }, { "tbname", tag->tbname() },
+			{ "ct", tag->ct() }, { "dt", tag->dt() }, { "mode", tag->mode() }, { "schema_id", tag->schema() }, { "schema_ct", 0 }
+		};
+		// synced is left alone, the next delta refresh picks the row up again with whatever the server made of it
+		rows[ tag->id() ] = std::move(row);
+	}
+
+	size_t TagMetadata::schemas() const {
+		return std::count_if( rows.begin(), rows.end(), []( const auto& item ) {
+				return item.second["schema_id"].template get<std::string>().size() > 0;
+				});
+	}
+
+	size_t TagMetadata::deactivated() const {
+		return std::count_if( rows.begin(), rows.end(), []( const auto& item ) {
+				return item.second["dt"].template get<int64_t>() != 0;
+				});
+	}
+
+	STagSnapshotPtr_t TagMetadata::build() const {
+		auto snapshot = std::make_shared<TagSnapshot>();
+		IdToTag_t& tags = snapshot->tags;
+		for ( const auto& [ id, row ] : rows ) {
+			tags.insert({ id, std::make_shared<Tag>( id, row["name"], row["pid"], row["tbname"], row["ct"], row["dt"], row["mode"], row["schema_id"] ) });
+		}
+
+		// erase tags that have parent id but no parent exists => side-effect of tag deactivation and/or maxEntryTime,
+		// repeated until nothing changes, so that whole orphaned subtrees go
+		size_t before = 0;
+		do {
+			before = tags.size();
+			container_erase_if( tags, [&tags]( const auto item ) {
+					return ( item.second->pid().size() && tags.find( item.second->pid() ) == tags.end() );
+					});
+		} while ( tags.size() != before );
+
+		// parent-child: assign children and parents
+		for ( auto& tag : tags ) {
+			if ( !(tag.second)->pid().size() ) { continue; }
+			auto rc = tags.find( ( tag.second )->pid() );
+			if ( rc == tags.end() ) { continue; }
+			( tag.second )->setParent( rc->second );
+			( rc->second )->addChild( tag.second );
+		}
+		// populate lookup map: path => Tag obj
+		for ( const auto& tag : tags ) {
+			snapshot->paths.insert({ ( tag.second )->path(), tag.second });
+		}
+		return snapshot;
+	}
+
+	void TagMetadata::clear() {
+		rows.clear();
+		synced = 0;
+	}
+
+	bool TagMetadata::load( const std::string& file, const std::string& source ) {
+		std::ifstream in( file );
+		if ( !in.is_open() ) { return false; }
+		std::string content{ std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>() };
+		nlohmann::json snapshot = nlohmann::json::parse( content.begin(), content.end(), nullptr, false, true );
+		if ( snapshot.is_discarded() || !snapshot.is_object() || !snapshot.contains("tags") ) {
+			CDBNPP_LOG_ERROR << "ignoring malformed metadata snapshot " << file << std::endl;
+			return false;
+		}
+		if ( snapshot.value( "source", std::string() ) != source ) {
+			return false;
+		}
+		clear();
+		merge( snapshot["tags"] );
+		synced = std::max( synced, snapshot.value( "synced", int64_t(0) ) );
+		return true;
+	}
+
+	bool TagMetadata::save( const std::string& file, const std::string& source ) const {
+		nlohmann::json snapshot = { { "source", source }, { "synced", synced }, { "tags", nlohmann::json::array() } };
+		for ( const auto& [ id, row ] : rows ) {
+			snapshot["tags"].push_back( row );
+		}
+
+		std::error_code ec;
+		fs::path path( file );
+		if ( path.has_parent_path() ) {
+			fs::create_directories( path.parent_path(), ec );
+		}
+
+		// concurrent readers never see partial files: write aside, then rename over the snapshot in one step
+		std::string tmp_path = file + ".tmp." + std::to_string( ::getpid() );
+		{
+			std::ofstream out( tmp_path, std::ios::trunc );
+			if ( !out.is_open() ) { return false; }
+			out << snapshot.dump();
+			out.close();
+			if ( out.fail() ) {
+				fs::remove( tmp_path, ec );
+				return false;
+			}
+		}
+		fs::rename( tmp_path, path, ec );
+		if ( ec ) {
+			fs::remove( tmp_path, ec );
+			return false;
+		}
+		return true;
+	}
+
+} // namespace CDB
+} // namespace NPP
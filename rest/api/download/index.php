@@ -8,6 +8,11 @@ if (
 	$auth->can_get()
 	&& $_SERVER['REQUEST_METHOD'] == 'GET'
 ) {
+	// stored data never changes once written, its id is a strong validator
+	$etag = '"' . md5( ( !empty($_GET['tbname']) ? $_GET['tbname'] : '' ) . '/' . ( !empty($_GET['id']) ? $_GET['id'] : '' ) ) . '"';
+	if ( !empty($_SERVER['HTTP_IF_NONE_MATCH']) && CDBNPP\Service::Instance()->cache_headers( $etag, true ) ) {
+		exit;
+	}
 	$data = CDBNPP\Service::Instance()->download();
 } else {
   header('HTTP/1.1 403 Forbidden');
@@ -18,10 +23,13 @@ if (
 if ( is_array($data) ) {
   if ( !empty($data['error']) ) {
     header('HTTP/1.1 400 Bad Request');
+    header('Cache-Control: no-store');
+    header_remove('ETag');
   }
 	header('Content-Type: application/json;charset=utf-8');
   echo json_encode( $data, JSON_PRETTY_PRINT | JSON_THROW_ON_ERROR | JSON_UNESCAPED_UNICODE );
 } else {
+  CDBNPP\Service::Instance()->cache_headers( $etag, true );
   header('Content-type: application/octet-stream');
   header('Content-Length: '.strlen($data));
 	echo $data;
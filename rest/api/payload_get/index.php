@@ -16,11 +16,15 @@ if (
 }
 
 if ( is_array($data) ) {
+  $body = json_encode( $data, JSON_PRETTY_PRINT | JSON_THROW_ON_ERROR | JSON_UNESCAPED_UNICODE );
   if ( !empty($data['error']) ) {
     header('HTTP/1.1 400 Bad Request');
+    header('Cache-Control: no-store');
+  } else if ( CDBNPP\Service::Instance()->cache_headers( '"' . md5( $body ) . '"', CDBNPP\Service::Instance()->payload_get_cacheable() ) ) {
+    exit;
   }
 	header('Content-Type: application/json;charset=utf-8');
-  echo json_encode( $data, JSON_PRETTY_PRINT | JSON_THROW_ON_ERROR | JSON_UNESCAPED_UNICODE );
+  echo $body;
 } else {
 	header('Content-Type: text/plain;charset=utf-8');
 	echo $data;
@@ -21,6 +21,11 @@ function sanitize_alnumscore( $str ) {
 	return preg_replace( "/[^a-zA-Z0-9\_]+/", "", $str );
 }
 
+// data formats, with an optional codec: "json+zstd"
+function sanitize_format( $str ) {
+	return preg_replace( "/[^a-zA-Z0-9\+]+/", "", $str );
+}
+
 // redirect to HTTPS, always
 if ( $_SERVER['REQUEST_SCHEME'] == 'http' || $_SERVER['HTTPS'] == 'off' ) {
 	$location = 'https://' . $_SERVER['HTTP_HOST'] . $_SERVER['REQUEST_URI'];
@@ -82,6 +82,33 @@ class Service {
 
 	// -------------------------------------------------------------------------------------------------------------
 
+	// answers which cannot change are marked cacheable and validated by ETag, the rest must be revalidated every time;
+	// returns true if the client copy is still good and 304 was sent, the caller should not send the body then
+	public function cache_headers( $etag, $cacheable ) {
+		if ( !$cacheable ) {
+			header('Cache-Control: no-cache');
+			return false;
+		}
+		$max_age = intval( Config::Instance()->get('settings', 'cache_max_age') );
+		header('Cache-Control: public, max-age=' . $max_age);
+		header('ETag: ' . $etag);
+		$if_none_match = !empty($_SERVER['HTTP_IF_NONE_MATCH']) ? $_SERVER['HTTP_IF_NONE_MATCH'] : '';
+		foreach ( explode( ',', $if_none_match ) as $tag ) {
+			$tag = trim( $tag );
+			if ( $tag === $etag || $tag === '*' ) {
+				header('HTTP/1.1 304 Not Modified');
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// lookups pinned to a max entry time in the past see a frozen set of payloads
+	public function payload_get_cacheable() {
+		$mt = !empty($_GET['mt']) ? intval($_GET['mt']) : 0;
+		return $mt > 0 && $mt <= time();
+	}
+
 	public function download() {
 		$c = $this->connect_read();
 		if ( is_array($c) && !empty($c['error']) ) {
@@ -105,6 +132,10 @@ class Service {
 		}
 
 		$res = $stmt->fetch(PDO::FETCH_ASSOC);
+		if ( !empty($res) && !empty($res['bdata']) ) {
+			// binary storage, see db:tables:migrate-blob
+			return is_resource($res['bdata']) ? stream_get_contents($res['bdata']) : $res['bdata'];
+		}
 		if ( empty($res) || empty($res['data']) ) {
 			return [ 'error' => 'no data found' ];
 		}
@@ -194,12 +225,30 @@ class Service {
 			return $c;
 		}
 
+		// since: only tags created, deactivated or given a schema at or after this time, plus totals to check the delta against
+		$since = !empty( $_GET['since'] ) ? intval( $_GET['since'] ) : 0;
+
+		$query = 'SELECT t.id, t.name, t.pid, t.tbname, t.ct, t.dt, t.mode, COALESCE(s.id,\'\') as schema_id, COALESCE(s.ct,0) as schema_ct FROM cdb_tags t LEFT JOIN cdb_schemas s ON t.id = s.pid';
 		try {
-			$tags = $this->dbh->query('SELECT t.id, t.name, t.pid, t.tbname, t.ct, t.dt, t.mode, COALESCE(s.id,\'\') as schema_id FROM cdb_tags t LEFT JOIN cdb_schemas s ON t.id = s.pid')->fetchAll(PDO::FETCH_ASSOC);
+			if ( $since > 0 ) {
+				$stmt = $this->dbh->prepare( $query . ' WHERE t.ct >= :since_ct OR t.dt >= :since_dt OR s.ct >= :since_sct' );
+				$stmt->execute([ 'since_ct' => $since, 'since_dt' => $since, 'since_sct' => $since ]);
+				$tags = $stmt->fetchAll(PDO::FETCH_ASSOC);
+				$tags_total = intval( $this->dbh->query('SELECT COUNT(*) FROM cdb_tags')->fetchColumn() );
+				$schemas_total = intval( $this->dbh->query('SELECT COUNT(*) FROM cdb_tags t WHERE EXISTS ( SELECT 1 FROM cdb_schemas s WHERE s.pid = t.id )')->fetchColumn() );
+				// deactivations may be dated before since, only their number tells the client it missed one
+				$deactivated_total = intval( $this->dbh->query('SELECT COUNT(*) FROM cdb_tags WHERE dt <> 0')->fetchColumn() );
+			} else {
+				$tags = $this->dbh->query( $query )->fetchAll(PDO::FETCH_ASSOC);
+			}
 		} catch( PDOException $e ) {
 			return [ 'error' => $e->getMessage() ];
 		}
 
+		if ( $since > 0 ) {
+			return [ 'tags' => !empty($tags) ? $tags : [], 'tags_total' => $tags_total, 'schemas_total' => $schemas_total,
+				'deactivated_total' => $deactivated_total ];
+		}
 		return [ 'tags' => !empty($tags) ? $tags : [] ];
 	}
 
@@ -377,7 +426,7 @@ class Service {
 		$et = intval( $_POST['et'] );
 		$run = intval( $_POST['run'] );
 		$seq = intval( $_POST['seq'] );
-		$fmt = sanitize_alnum($_POST['fmt']);
+		$fmt = sanitize_format($_POST['fmt']);
 		$uri = sanitize_alnum($_POST['uri']);
 		$tbname = sanitize_alnumscore($_POST['tbname']);
 		$data = $_POST['data'];
@@ -406,9 +455,26 @@ class Service {
 		if ( strpos($uri, 'db://') === 0 && $data_size > 0 ) {
 			// insert data
 			try {
-				$stmt = $this->dbh->prepare('INSERT INTO cdb_data_'.$tbname
-					.' ( id, pid, ct, dt, data, size ) VALUES ( :id, :pid, :ct, :dt, :data, :size )');
-				$stmt->execute([ 'id' => $id, 'pid' => $pid	, 'ct' => $ct, 'dt' => 0, 'data' => $data, 'size' => $data_size ]);
+				if ( strpos($fmt, '+') !== false ) {
+					// compressed data is binary, only the mysql tables have a blob column for it
+					if ( $this->dbh->getAttribute(PDO::ATTR_DRIVER_NAME) != 'mysql' ) {
+						$this->dbh->rollBack();
+						return [ 'error' => 'compressed payloads need binary storage, store them uncompressed' ];
+					}
+					$stmt = $this->dbh->prepare('INSERT INTO cdb_data_'.$tbname
+						.' ( id, pid, ct, dt, data, bdata, size ) VALUES ( :id, :pid, :ct, :dt, \'\', :bdata, :size )');
+					$stmt->bindValue('id', $id);
+					$stmt->bindValue('pid', $pid);
+					$stmt->bindValue('ct', $ct, PDO::PARAM_INT);
+					$stmt->bindValue('dt', 0, PDO::PARAM_INT);
+					$stmt->bindValue('bdata', $data, PDO::PARAM_LOB);
+					$stmt->bindValue('size', $data_size, PDO::PARAM_INT);
+					$stmt->execute();
+				} else {
+					$stmt = $this->dbh->prepare('INSERT INTO cdb_data_'.$tbname
+						.' ( id, pid, ct, dt, data, size ) VALUES ( :id, :pid, :ct, :dt, :data, :size )');
+					$stmt->execute([ 'id' => $id, 'pid' => $pid	, 'ct' => $ct, 'dt' => 0, 'data' => $data, 'size' => $data_size ]);
+				}
 			} catch ( PDOException $e ) {
 				$this->dbh->rollBack();
 				return [ 'error' => $e->getMessage() ];
@@ -435,6 +501,64 @@ class Service {
 		$run = !empty($_GET['run']) ? intval($_GET['run']) : 0;
 		$seq = !empty($_GET['seq']) ? intval($_GET['seq']) : 0;
 
+		$data = $this->payload_lookup( $tbname, $flavor, $mt, $evt, $run, $seq );
+		if ( !empty($data['error']) ) {
+			return $data;
+		}
+		if ( empty($data) ) {
+			return [ 'error' => 'no results' ];
+		}
+
+		return [ 'payload' => $data ];
+	}
+
+	// many structs in one request: requests = { "et", "run", "seq", "requests": [ { "tb", "f": [ flavors ], "mt", "mode" } ] }
+	// replies with the payloads found, each tagged with the index of its request; structs without payloads are skipped
+	public function payloads_get() {
+
+		$c = $this->connect_read();
+		if ( is_array($c) && !empty($c['error']) ) {
+			return $c;
+		}
+
+		$req = !empty($_POST['requests']) ? json_decode( $_POST['requests'], true ) : null;
+		if ( !is_array($req) || empty($req['requests']) || !is_array($req['requests']) ) {
+			return [ 'error' => 'malformed bulk request' ];
+		}
+
+		$evt = !empty($req['et']) ? intval($req['et']) : 0;
+		$run = !empty($req['run']) ? intval($req['run']) : 0;
+		$seq = !empty($req['seq']) ? intval($req['seq']) : 0;
+
+		$payloads = [];
+		foreach ( $req['requests'] as $idx => $r ) {
+			$tbname = !empty($r['tb']) ? sanitize_alnumscore($r['tb']) : '';
+			$mt = !empty($r['mt']) ? intval($r['mt']) : 0;
+			$mode = !empty($r['mode']) ? intval($r['mode']) : 0;
+			if ( empty($tbname) || empty($r['f']) || !is_array($r['f']) ) {
+				continue;
+			}
+			// flavors are given in order of preference, first one found wins
+			foreach ( $r['f'] as $f ) {
+				$data = $this->payload_lookup( $tbname, sanitize_alnum($f), $mt,
+					$mode == 1 ? $evt : 0, $mode == 2 ? $run : 0, $mode == 2 ? $seq : 0 );
+				if ( !empty($data['error']) ) {
+					return $data;
+				}
+				if ( !empty($data) ) {
+					$data['idx'] = $idx;
+					$payloads[] = $data;
+					break;
+				}
+			}
+		}
+
+		return [ 'payloads' => $payloads ];
+	}
+
+	// latest payload of a flavor valid at event time (or run/seq), with endTime filled in; empty array if there is none
+	private function payload_lookup( $tbname, $flavor, $mt, $evt, $run, $seq ) {
+
 		$data = [];
 
 		try {
@@ -471,31 +595,30 @@ class Service {
 
 			$data = $stmt->fetch(PDO::FETCH_ASSOC);
 			if ( empty($data) ) {
-				return [ 'error' => 'no results' ];
+				return [];
 			}
 
 		} catch ( PDOException $e ) {
 			return [ 'error' => $e->getMessage() ];
 		}
 
-		// if no end time for the entry provided - find it
+		// if no end time for the entry provided - it is valid until the next one begins
 		if ( !empty($data) && $data['et'] == 0 ) {
 			try {
   		  $query = 'SELECT bt FROM cdb_iov_' . $tbname . ' WHERE '
     		  .'flavor = :flavor '
-      	  .'AND bt >= :evt1 '
-        	.'AND ( et = 0 OR et < :evt2 )'
+      	  .'AND bt > :evt1 '
         	.( $mt > 0 ? 'AND ct <= :mt1 ' : '' )
         	.( $mt > 0 ? 'AND ( dt = 0 OR dt > :mt2 ) ' : '' )
         	.'ORDER BY bt ASC LIMIT 1';
 				$stmt = $this->dbh->prepare( $query );
 				if ( $mt > 0 ) {
-					$stmt->execute([ 'flavor' => $flavor, 'evt1' => $evt, 'evt2' => $evt, 'mt1' => $mt, 'mt2' => $mt ]);
+					$stmt->execute([ 'flavor' => $flavor, 'evt1' => $evt, 'mt1' => $mt, 'mt2' => $mt ]);
 				} else {
-					$stmt->execute([ 'flavor' => $flavor, 'evt1' => $evt, 'evt2' => $evt ]);
+					$stmt->execute([ 'flavor' => $flavor, 'evt1' => $evt ]);
 				}
 				$edata = $stmt->fetch(PDO::FETCH_ASSOC);
-				$bt = intval($edata['bt']);
+				$bt = !empty($edata) ? intval($edata['bt']) : 0;
 				if ( $bt == 0 ) { $bt = PHP_INT_MAX; }
 				$data['et'] = $bt;
 			} catch ( PDOException $e ) {
@@ -503,7 +626,7 @@ class Service {
 			}
 		}
 
-		return [ 'payload' => $data ];
+		return $data;
 	}
 
 	// -------------------------------------------------------------------------------------------------------------
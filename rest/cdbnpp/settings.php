@@ -6,7 +6,8 @@ function cdbnpp_settings() {
 
 		'settings' => [
 			'version' => 1.0,
-			'contact_person' => 'Dmitry Arkhipkin, arkhipkin@gmail.com'
+			'contact_person' => 'Dmitry Arkhipkin, arkhipkin@gmail.com',
+			'cache_max_age' => 86400 // seconds HTTP caches may keep answers which cannot change
 		],
 
 		'auth' => [
@@ -97,6 +98,7 @@ function cdbnpp_settings() {
 					`ct` bigint(20) NOT NULL,
 					`dt` bigint(20) NOT NULL DEFAULT 0,
 					`data` text NOT NULL,
+					`bdata` longblob NULL,
 					`size` bigint(20) NOT NULL DEFAULT 0,
 					PRIMARY KEY (`id`,`pid`,`ct`,`dt`),
 					UNIQUE KEY `cdb_data_calibrations_tpc_struct1_id` (`id`)